@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "source.h"
+#include "dfacache.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define DFA_CACHE_MKDIR(dir) _mkdir(dir)
+#else
+#include <sys/stat.h>
+#define DFA_CACHE_MKDIR(dir) mkdir(dir, 0755)
+#endif
+
+// FNV-1a over the format version, the minimize flag, the NFA construction
+// and the regex. Only minimized DFAs come out the same from both constructions.
+uint64_t DFA_cache_key(char* regex, bool minimize, enum FAConstruction construction){
+    uint64_t key = 14695981039346656037ULL;
+    unsigned char prefix[3] = {DFA_CACHE_VERSION, minimize, construction};
+
+    for(int i = 0;i<3;i++){
+        key = (key ^ prefix[i]) * 1099511628211ULL;
+    }
+    for(char* c = regex;*c != '\0';c++){
+        key = (key ^ (unsigned char) *c) * 1099511628211ULL;
+    }
+
+    return key;
+}
+
+void DFA_cache_path(uint64_t key, char* out_path, size_t out_size){
+    snprintf(out_path, out_size, "%s/%016llx.dfa", DFA_CACHE_DIR, (unsigned long long) key);
+}
+
+// Checks every index the scanners will follow: byte classes name an existing
+// column, transitions land on a state or the dead row, the dead row only
+// leads back to itself, and accepting states exist. A file failing any of
+// these would have the table indexed out of bounds.
+bool DFA_cache_entries_valid(DFACacheHeader header, int32_t* next, int32_t* accept, AcceptableState* acceptable_states){
+    int32_t states_count = header.states_count;
+    int32_t dead_state = states_count;
+
+    if(header.initial_state < 0 || header.initial_state >= states_count){
+        return false;
+    }
+    for(int b = 0;b<DFA_TABLE_WIDTH;b++){
+        if(header.classes[b] >= header.class_count){
+            return false;
+        }
+    }
+    for(size_t i = 0;i<(size_t) (states_count + 1) * header.class_count;i++){
+        if(next[i] < 0 || next[i] > dead_state){
+            return false;
+        }
+    }
+    for(int k = 0;k<header.class_count;k++){
+        if(next[(size_t) dead_state * header.class_count + k] != dead_state){
+            return false;
+        }
+    }
+    for(int s = 0;s<states_count;s++){
+        if(accept[s] < -1){
+            return false;
+        }
+    }
+    if(accept[dead_state] != -1){
+        return false;
+    }
+    for(int i = 0;i<header.acceptable_count;i++){
+        if(acceptable_states[i].state < 0 || acceptable_states[i].state >= states_count){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rebuilds the DFA stored for `regex`. Anything that doesn't match exactly,
+// a different version, key or regex, a truncated file or one whose tables
+// point outside themselves, counts as a miss.
+bool DFA_cache_load(char* regex, bool minimize, enum FAConstruction construction, FA* dfa){
+    uint64_t key = DFA_cache_key(regex, minimize, construction);
+    char path[512];
+    DFA_cache_path(key, path, sizeof(path));
+
+    Source source;
+    if(!source_open(&source, path)){
+        return false;
+    }
+
+    DFACacheHeader header;
+    size_t regex_length = strlen(regex);
+    bool valid = source.length >= sizeof(DFACacheHeader);
+    if(valid){
+        memcpy(&header, source.data, sizeof(DFACacheHeader));
+        valid = memcmp(header.magic, DFA_CACHE_MAGIC, 8) == 0
+            && header.version == DFA_CACHE_VERSION
+            && header.minimized == minimize
+            && header.construction == (int32_t) construction
+            && header.key == key
+            && header.regex_length == (int32_t) regex_length
+            && header.states_count >= 0
+            && header.class_count > 0 && header.class_count <= DFA_TABLE_WIDTH
+            && header.acceptable_count >= 0;
+    }
+
+    if(!valid){
+        source_close(&source);
+        return false;
+    }
+
+    size_t rows = (size_t) header.states_count + 1;
+    size_t regex_offset = sizeof(DFACacheHeader);
+    size_t next_offset = regex_offset + DFA_CACHE_ALIGN(regex_length);
+    size_t accept_offset = next_offset + DFA_CACHE_ALIGN(rows * header.class_count * sizeof(int32_t));
+    size_t acceptable_offset = accept_offset + DFA_CACHE_ALIGN(rows * sizeof(int32_t));
+    size_t total = acceptable_offset + header.acceptable_count * sizeof(AcceptableState);
+
+    valid = source.length >= total && memcmp(source.data + regex_offset, regex, regex_length) == 0
+        && DFA_cache_entries_valid(header, (int32_t*) (source.data + next_offset), (int32_t*) (source.data + accept_offset), (AcceptableState*) (source.data + acceptable_offset));
+    if(!valid){
+        source_close(&source);
+        return false;
+    }
+
+    DFATable* table = malloc(sizeof(DFATable));
+    table->states_count = header.states_count;
+    table->dead_state = header.states_count;
+    table->class_count = header.class_count;
+    memcpy(table->classes, header.classes, DFA_TABLE_WIDTH);
+    table->next = malloc(rows * table->class_count * sizeof(int));
+    memcpy(table->next, source.data + next_offset, rows * table->class_count * sizeof(int));
+    table->accept = malloc(rows * sizeof(int));
+    memcpy(table->accept, source.data + accept_offset, rows * sizeof(int));
+    DFA_table_find_loops(table);
+
+    FA_initialize(dfa);
+    dfa->initial_state = header.initial_state;
+    dfa->table = table;
+    for(int i = 0;i<DFA_TABLE_WIDTH;i++){
+        dfa->alphabet[i] = header.alphabet[i];
+    }
+    for(int s = 0;s<header.states_count;s++){
+        dynarray_push(dfa->states, s);
+    }
+
+    AcceptableState* acceptable_states = (AcceptableState*) (source.data + acceptable_offset);
+    for(int i = 0;i<header.acceptable_count;i++){
+        dynarray_push(dfa->acceptable_states, acceptable_states[i]);
+    }
+
+    for(int s = 0;s<header.states_count;s++){
+        for(int c = 0;c<DFA_TABLE_WIDTH;c++){
+            int target = DFA_table_next(table, s, c);
+            if(dfa->alphabet[c] && target != table->dead_state){
+                Transition trans;
+                trans.state_from = s;
+                trans.state_to = target;
+                trans.trans_char = (char) c;
+                trans.byte_set = -1;
+                dynarray_push(dfa->transitions, trans);
+            }
+        }
+    }
+
+    source_close(&source);
+    return true;
+}
+
+// Writes to a temporary file first so a concurrent run never maps half a file
+bool DFA_cache_store(FA dfa, char* regex, bool minimize, enum FAConstruction construction){
+    DFATable* table = dfa.table;
+    uint64_t key = DFA_cache_key(regex, minimize, construction);
+    char path[512];
+    char tmp_path[520];
+    DFA_cache_path(key, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    DFA_CACHE_MKDIR(DFA_CACHE_DIR);
+    FILE* out = fopen(tmp_path, "wb");
+    if(out == NULL){
+        return false;
+    }
+
+    DFACacheHeader header;
+    memset(&header, 0, sizeof(DFACacheHeader));
+    memcpy(header.magic, DFA_CACHE_MAGIC, 8);
+    header.version = DFA_CACHE_VERSION;
+    header.minimized = minimize;
+    header.construction = construction;
+    header.key = key;
+    header.regex_length = (int32_t) strlen(regex);
+    header.states_count = table->states_count;
+    header.initial_state = dfa.initial_state;
+    header.class_count = table->class_count;
+    header.acceptable_count = dynarray_length(dfa.acceptable_states);
+    for(int i = 0;i<DFA_TABLE_WIDTH;i++){
+        header.alphabet[i] = dfa.alphabet[i];
+    }
+    memcpy(header.classes, table->classes, DFA_TABLE_WIDTH);
+
+    size_t rows = (size_t) table->states_count + 1;
+    char padding[8] = {0};
+    size_t next_size = rows * table->class_count * sizeof(int32_t);
+    size_t accept_size = rows * sizeof(int32_t);
+
+    fwrite(&header, sizeof(DFACacheHeader), 1, out);
+    fwrite(regex, 1, header.regex_length, out);
+    fwrite(padding, 1, DFA_CACHE_ALIGN(header.regex_length) - header.regex_length, out);
+    fwrite(table->next, 1, next_size, out);
+    fwrite(padding, 1, DFA_CACHE_ALIGN(next_size) - next_size, out);
+    fwrite(table->accept, 1, accept_size, out);
+    fwrite(padding, 1, DFA_CACHE_ALIGN(accept_size) - accept_size, out);
+    fwrite(dfa.acceptable_states, sizeof(AcceptableState), header.acceptable_count, out);
+
+    bool written = !ferror(out);
+    written = fclose(out) == 0 && written;
+    if(!written || rename(tmp_path, path) != 0){
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+void DFA_profile_path(uint64_t key, char* out_path, size_t out_size){
+    snprintf(out_path, out_size, "%s/%016llx.prof", DFA_CACHE_DIR, (unsigned long long) key);
+}
+
+// Reads back the profile stored for `regex`. It only counts if it was taken
+// on a DFA shaped exactly like `dfa`, which must still be in the numbering
+// the cache gave it.
+bool DFA_profile_load(FA dfa, char* regex, bool minimize, enum FAConstruction construction, DFAProfile* profile){
+    uint64_t key = DFA_cache_key(regex, minimize, construction);
+    char path[512];
+    DFA_profile_path(key, path, sizeof(path));
+
+    Source source;
+    if(!source_open(&source, path)){
+        return false;
+    }
+
+    if(source.length < sizeof(DFAProfileHeader)){
+        source_close(&source);
+        return false;
+    }
+
+    DFAProfileHeader header;
+    memcpy(&header, source.data, sizeof(DFAProfileHeader));
+    bool valid = memcmp(header.magic, DFA_PROFILE_MAGIC, 8) == 0
+        && header.version == DFA_CACHE_VERSION
+        && header.key == key
+        && header.states_count == dfa.table->states_count
+        && header.class_count == dfa.table->class_count
+        && header.initial_state == dfa.initial_state;
+
+    size_t visits_size = (size_t) header.states_count * sizeof(uint64_t);
+    size_t transitions_size = (size_t) header.states_count * header.class_count * sizeof(uint64_t);
+    if(!valid || source.length < sizeof(DFAProfileHeader) + visits_size + transitions_size){
+        source_close(&source);
+        return false;
+    }
+
+    *profile = DFA_profile_create(dfa.table);
+    memcpy(profile->visits, source.data + sizeof(DFAProfileHeader), visits_size);
+    memcpy(profile->transitions, source.data + sizeof(DFAProfileHeader) + visits_size, transitions_size);
+
+    source_close(&source);
+    return true;
+}
+
+// Same temporary file dance as DFA_cache_store
+bool DFA_profile_store(FA dfa, DFAProfile profile, char* regex, bool minimize, enum FAConstruction construction){
+    uint64_t key = DFA_cache_key(regex, minimize, construction);
+    char path[512];
+    char tmp_path[520];
+    DFA_profile_path(key, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    DFA_CACHE_MKDIR(DFA_CACHE_DIR);
+    FILE* out = fopen(tmp_path, "wb");
+    if(out == NULL){
+        return false;
+    }
+
+    DFAProfileHeader header;
+    memset(&header, 0, sizeof(DFAProfileHeader));
+    memcpy(header.magic, DFA_PROFILE_MAGIC, 8);
+    header.version = DFA_CACHE_VERSION;
+    header.key = key;
+    header.states_count = profile.states_count;
+    header.class_count = profile.class_count;
+    header.initial_state = dfa.initial_state;
+
+    fwrite(&header, sizeof(DFAProfileHeader), 1, out);
+    fwrite(profile.visits, sizeof(uint64_t), profile.states_count, out);
+    fwrite(profile.transitions, sizeof(uint64_t), (size_t) profile.states_count * profile.class_count, out);
+
+    bool written = !ferror(out);
+    written = fclose(out) == 0 && written;
+    if(!written || rename(tmp_path, path) != 0){
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
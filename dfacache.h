@@ -0,0 +1,61 @@
+#ifndef DFACACHE
+#define DFACACHE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "scanner.h"
+
+#define DFA_CACHE_DIR "output/dfa_cache"
+#define DFA_CACHE_MAGIC "LEXDFA\0"
+// Bumped whenever the file layout changes or a rule string can compile to a
+// different automaton, 4 since "/u{" became a codepoint range escape
+#define DFA_CACHE_VERSION 4
+#define DFA_PROFILE_MAGIC "LEXPROF"
+#define DFA_CACHE_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+// Fixed size head of a cached DFA file. It is followed, each section padded
+// to 8 bytes so the file can be used straight from a mapping, by:
+//   char    regex[regex_length]                   the regex
+//   int32_t next[(states_count + 1) * class_count]
+//   int32_t accept[states_count + 1]
+//   AcceptableState acceptable_states[acceptable_count]
+typedef struct DFACacheHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t minimized;
+    uint64_t key;
+    int32_t regex_length;
+    int32_t states_count;
+    int32_t initial_state;
+    int32_t class_count;
+    int32_t acceptable_count;
+    int32_t construction;
+    unsigned char alphabet[256];
+    unsigned char classes[256];
+} DFACacheHeader;
+
+// Head of the profile stored next to a cached DFA, same key with a .prof
+// extension. It is followed by:
+//   uint64_t visits[states_count]
+//   uint64_t transitions[states_count * class_count]
+// The counts are in the state numbering of the cached DFA.
+typedef struct DFAProfileHeader{
+    char magic[8];
+    uint32_t version;
+    int32_t states_count;
+    uint64_t key;
+    int32_t class_count;
+    int32_t initial_state;
+} DFAProfileHeader;
+
+uint64_t DFA_cache_key(char* regex, bool minimize, enum FAConstruction construction);
+void DFA_cache_path(uint64_t key, char* out_path, size_t out_size);
+bool DFA_cache_entries_valid(DFACacheHeader header, int32_t* next, int32_t* accept, AcceptableState* acceptable_states);
+bool DFA_cache_load(char* regex, bool minimize, enum FAConstruction construction, FA* dfa);
+bool DFA_cache_store(FA dfa, char* regex, bool minimize, enum FAConstruction construction);
+void DFA_profile_path(uint64_t key, char* out_path, size_t out_size);
+bool DFA_profile_load(FA dfa, char* regex, bool minimize, enum FAConstruction construction, DFAProfile* profile);
+bool DFA_profile_store(FA dfa, DFAProfile profile, char* regex, bool minimize, enum FAConstruction construction);
+
+#endif // DFACACHE
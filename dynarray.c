@@ -82,6 +82,27 @@ void *_dynarray_push(void *arr, void *xptr)
 }
 
 
+// Appends `count` units copied from `src`, growing the buffer at most once.
+void *_dynarray_extend(void *arr, void *src, size_t count)
+{
+    size_t needed = dynarray_length(arr) + count;
+    if (needed > dynarray_capacity(arr)) {
+        size_t new_cap = dynarray_capacity(arr) > 0 ? dynarray_capacity(arr) : 1;
+        while (new_cap < needed)
+            new_cap *= DYNARRAY_RESIZE_FACTOR;
+
+        void *temp = _dynarray_create(new_cap, dynarray_stride(arr));
+        memcpy(temp, arr, dynarray_length(arr) * dynarray_stride(arr));
+        _dynarray_field_set(temp, LENGTH, dynarray_length(arr));
+        _dynarray_destroy(arr);
+        arr = temp;
+    }
+
+    memcpy(arr + dynarray_length(arr) * dynarray_stride(arr), src, count * dynarray_stride(arr));
+    _dynarray_field_set(arr, LENGTH, needed);
+    return arr;
+}
+
 void *_dynarray_pushleft(void *arr, void *xptr)
 {
     if (dynarray_length(arr) >= dynarray_capacity(arr))
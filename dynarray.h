@@ -29,6 +29,7 @@ void *_dynarray_resize(void *arr);
 
 void *_dynarray_push(void *arr, void *xptr);
 void *_dynarray_pushleft(void *arr, void *xptr);
+void *_dynarray_extend(void *arr, void *src, size_t count);
 void _dynarray_replace(void *arr, void *xptr, int index);
 void _dynarray_pop(void *arr, void *dest);
 
@@ -42,6 +43,7 @@ void _dynarray_pop(void *arr, void *dest);
 
 #define dynarray_push(arr, x) arr = _dynarray_push(arr, &x)
 #define dynarray_pushleft(arr, x) arr = _dynarray_pushleft(arr, &x)
+#define dynarray_extend(arr, src, count) arr = _dynarray_extend(arr, src, count)
 #define dynarray_replace(arr, x, ind) _dynarray_replace(arr, &x, int index)
 #define dynarray_get_last(arr) arr[dynarray_length(arr)-1]
 
@@ -27,6 +27,28 @@ Hash _hash_create(int node_amount, size_t stride, size_t key_stride, void* ptr_f
 }
 
 
+// Doubles the bucket array and relinks every node by the full hash it
+// already stores, so nothing is hashed again
+void _hash_grow(Hash *hash){
+    int new_capacity = hash->capacity * 2;
+    Node** new_table = calloc(new_capacity, sizeof(Node*));
+
+    for(int i=0;i<hash->capacity;i++){
+        Node* tmp = hash->table[i];
+        while(tmp != NULL){
+            Node* next = tmp->next;
+            int bucket_id = tmp->hash_index%new_capacity;
+            tmp->next = new_table[bucket_id];
+            new_table[bucket_id] = tmp;
+            tmp = next;
+        }
+    }
+
+    free(hash->table);
+    hash->table = new_table;
+    hash->capacity = new_capacity;
+}
+
 bool _hash_in(Hash *hash, void *xptr, void *str_ptr, bool (*f_equality_ptr)(void*, void*), int action, bool uses_key_storage){
     uint64_t hash_id = hash->f_ptr(xptr);
 
@@ -39,8 +61,11 @@ bool _hash_in(Hash *hash, void *xptr, void *str_ptr, bool (*f_equality_ptr)(void
 
         while(tmp != NULL){
             uint64_t curr_hash_id = tmp->hash_index;
-            bool bucket_pass;
-            if(uses_key_storage){
+            bool bucket_pass = false;
+            if(hash_id != curr_hash_id){
+                // Different full hash, skip the equality check
+            }
+            else if(uses_key_storage){
                 bucket_pass = f_equality_ptr(xptr, (char*) hash->key_storage + tmp->storage_index * hash->key_stride);
             }
             else{
@@ -96,6 +121,9 @@ bool _hash_in(Hash *hash, void *xptr, void *str_ptr, bool (*f_equality_ptr)(void
         hash->table[bucket_id] = node;
 
         hash->count ++;
+        if(hash->count > hash->capacity * HASH_MAX_LOAD){
+            _hash_grow(hash);
+        }
     }
 
     return false;
@@ -114,8 +142,11 @@ void *_hash_get(Hash *hash, void *xptr, bool (*f_equality_ptr)(void*, void*), bo
         while(tmp != NULL){
             uint64_t curr_hash_id = tmp->hash_index;
 
-            bool bucket_pass;
-            if(uses_key_storage){
+            bool bucket_pass = false;
+            if(hash_id != curr_hash_id){
+                // Different full hash, skip the equality check
+            }
+            else if(uses_key_storage){
                 bucket_pass = f_equality_ptr(xptr, (char*) hash->key_storage + tmp->storage_index * hash->key_stride);
             }
             else{
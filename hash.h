@@ -1,3 +1,7 @@
+#ifndef HASH
+#define HASH
+
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>  
 #include <stdint.h>
@@ -20,6 +24,9 @@
 #define hash_int(num) _hash_int(&num)
 #define str_hash(str) _djb33_hash(&str)
 
+// Average chain length past which the bucket array is doubled
+#define HASH_MAX_LOAD 2
+
 typedef struct Node{
     int storage_index;
     uint64_t hash_index;
@@ -40,10 +47,13 @@ typedef struct Hash{
 
 Hash _hash_create(int node_amount, size_t stride, size_t key_stride, void* ptr_func, bool uses_key_storage);
 void _hash_destroy(Hash *hash, bool uses_key_storage);
+void _hash_grow(Hash *hash);
 bool _hash_in(Hash *hash, void *xptr, void *str_ptr, bool (*f_equality_ptr)(void*, void*), int action, bool uses_key_storage);
 void *_hash_get(Hash *hash, void *xptr, bool (*f_equality_ptr)(void*, void*), bool uses_key_storage);
 void *_hash_to_list(Hash *hash);
 uint64_t _hash_int(void *xptr);
 uint32_t _djb33_hash(void *xptr);
 uint64_t hash_combine( uint64_t lhs, uint64_t rhs );
-bool string_equal(void* ptr1, void* ptr2);
\ No newline at end of file
+bool string_equal(void* ptr1, void* ptr2);
+
+#endif // HASH
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "keywords.h"
+
+// FNV-1a started from `seed`, then avalanched so that two seeds send a pair
+// of words to unrelated slots. A plain additive hash such as djb33 moves two
+// words of the same length by the same amount under every seed, so once
+// they collide no seed could separate them.
+uint32_t keyword_hash(const char* word, size_t length, uint32_t seed){
+    uint32_t h = 2166136261u ^ seed;
+    for(size_t i = 0;i<length;i++){
+        h = (h ^ (unsigned char) word[i]) * 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Hash and displace: buckets are placed largest first, each trying seeds
+// until all of its keywords land on free slots. With about two keywords per
+// bucket a seed is found after a handful of tries.
+KeywordTable* keyword_table_create(Keyword* keywords, int count, int identifier_category){
+    assert(count > 0);
+    KeywordTable* table = malloc(sizeof(KeywordTable));
+    table->count = count;
+    table->bucket_count = count / 2 + 1;
+    table->identifier_category = identifier_category;
+    table->seeds = calloc(table->bucket_count, sizeof(uint32_t));
+    table->slots = malloc(count * sizeof(Keyword));
+    table->lengths = malloc(count * sizeof(size_t));
+
+    int** buckets = malloc(table->bucket_count * sizeof(int*));
+    for(int b = 0;b<table->bucket_count;b++){
+        buckets[b] = dynarray_create(int);
+    }
+    for(int i = 0;i<count;i++){
+        int b = keyword_hash(keywords[i].word, strlen(keywords[i].word), KEYWORD_BUCKET_SEED) % table->bucket_count;
+        for(int j = 0;j<dynarray_length(buckets[b]);j++){
+            // The same word twice could never be given two slots
+            assert(strcmp(keywords[buckets[b][j]].word, keywords[i].word) != 0);
+        }
+        dynarray_push(buckets[b], i);
+    }
+
+    bool* taken = calloc(count, sizeof(bool));
+    int* bucket_slots = malloc(count * sizeof(int));
+    for(int size = count;size > 0;size--){
+        for(int b = 0;b<table->bucket_count;b++){
+            if(dynarray_length(buckets[b]) != size){
+                continue;
+            }
+
+            uint32_t seed = 1;
+            while(true){
+                assert(seed < KEYWORD_SEED_LIMIT);
+                bool placed = true;
+                for(int j = 0;j<size && placed;j++){
+                    Keyword keyword = keywords[buckets[b][j]];
+                    bucket_slots[j] = keyword_hash(keyword.word, strlen(keyword.word), seed) % count;
+                    placed = !taken[bucket_slots[j]];
+                    for(int k = 0;k<j && placed;k++){
+                        placed = bucket_slots[k] != bucket_slots[j];
+                    }
+                }
+                if(placed){
+                    break;
+                }
+                seed++;
+            }
+
+            table->seeds[b] = seed;
+            for(int j = 0;j<size;j++){
+                taken[bucket_slots[j]] = true;
+                table->slots[bucket_slots[j]] = keywords[buckets[b][j]];
+                table->lengths[bucket_slots[j]] = strlen(keywords[buckets[b][j]].word);
+            }
+        }
+    }
+
+    for(int b = 0;b<table->bucket_count;b++){
+        dynarray_destroy(buckets[b]);
+    }
+    free(buckets);
+    free(taken);
+    free(bucket_slots);
+
+    return table;
+}
+
+void keyword_table_destroy(KeywordTable* table){
+    free(table->seeds);
+    free(table->slots);
+    free(table->lengths);
+    free(table);
+}
+
+// Category of `word` if it is a keyword, -1 otherwise
+int keyword_table_lookup(const KeywordTable* table, const char* word, size_t length){
+    uint32_t bucket = keyword_hash(word, length, KEYWORD_BUCKET_SEED) % table->bucket_count;
+    uint32_t slot = keyword_hash(word, length, table->seeds[bucket]) % table->count;
+    if(table->lengths[slot] == length && memcmp(table->slots[slot].word, word, length) == 0){
+        return table->slots[slot].category;
+    }
+    return -1;
+}
+
+// Category a token scanned as `category` ends up with: an identifier that
+// spells a keyword takes the keyword's category, anything else is left as is
+int keyword_table_category(const KeywordTable* table, const char* word, size_t length, int category){
+    if(category != table->identifier_category){
+        return category;
+    }
+
+    int keyword_category = keyword_table_lookup(table, word, length);
+    return keyword_category == -1 ? category : keyword_category;
+}
+
+// Re-categorizes the identifiers of a scanned stream that are keywords.
+// Lexer does this on every scan, the scanner_spans_* functions (parallel,
+// direct and lazy included) return keywords as identifiers until this is
+// called on their stream. Tokens from the pull scanner and scanner_loop_*
+// go through keyword_table_category one by one.
+void token_stream_apply_keywords(TokenStream* stream, const KeywordTable* table){
+    for(int i = 0;i<dynarray_length(stream->spans);i++){
+        TokenSpan* span = &stream->spans[i];
+        span->category = keyword_table_category(table, token_stream_word(*stream, i), span->length, span->category);
+    }
+}
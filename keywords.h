@@ -0,0 +1,38 @@
+#ifndef KEYWORDS
+#define KEYWORDS
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scanner.h"
+
+#define KEYWORD_BUCKET_SEED 5381
+#define KEYWORD_SEED_LIMIT 1000000
+
+typedef struct Keyword{
+    char* word;
+    int category;
+} Keyword;
+
+// Minimal perfect hash over a fixed set of keywords, built when the lexer
+// is. A word hashes to a bucket, the bucket's seed hashes it again to one of
+// `count` slots, and the seeds are picked so no two keywords share a slot.
+// Looking a word up is two hashes and one compare.
+typedef struct KeywordTable{
+    int count;
+    int bucket_count;
+    int identifier_category;
+    uint32_t* seeds;
+    Keyword* slots;
+    size_t* lengths;
+} KeywordTable;
+
+uint32_t keyword_hash(const char* word, size_t length, uint32_t seed);
+KeywordTable* keyword_table_create(Keyword* keywords, int count, int identifier_category);
+void keyword_table_destroy(KeywordTable* table);
+int keyword_table_lookup(const KeywordTable* table, const char* word, size_t length);
+int keyword_table_category(const KeywordTable* table, const char* word, size_t length, int category);
+void token_stream_apply_keywords(TokenStream* stream, const KeywordTable* table);
+
+#endif // KEYWORDS
@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "keywords.h"
+#include "language.h"
+
+char* language_lexing_rules = "(=?)$19|(>=)$20|(<=)$21|(>)$22|(<)$23|+$07|-$08|/*$09|//$10|/($11|/)$12|/[$15|/]$16|.$17|,$18|(0|[1-9][0-9]*)$13|(\"([a-zA-Z0-9_/u{80-10FFFF}][a-zA-Z0-9_/u{80-10FFFF}]*)\")$24|({)$39|(})$40|(;)$41|(<-)$42|(=)$43|(:)$44|(->)$45|([a-zA-Z_/u{80-10FFFF}][a-zA-Z0-9_/u{80-10FFFF}]*)$14|(( |\n|\t|\r)( |\n|\t|\r)*)$01";
+
+int language_ignore_categories[] = {1};
+int language_ignore_count = sizeof(language_ignore_categories) / sizeof(language_ignore_categories[0]);
+
+Keyword language_keywords[] = {
+    {"true",     25},
+    {"false",    26},
+    {"if",       32},
+    {"else",     33},
+    {"while",    34},
+    {"for",      35},
+    {"Init",     36},
+    {"Proc",     37},
+    {"return",   38},
+    {"int",      46},
+    {"bool",     47},
+    {"float",    48},
+    {"break",    49},
+    {"continue", 50},
+    {"goto",     51}
+};
+int language_keyword_count = sizeof(language_keywords) / sizeof(language_keywords[0]);
@@ -0,0 +1,24 @@
+#ifndef LANGUAGE
+#define LANGUAGE
+
+#include <stddef.h>
+
+#include "keywords.h"
+
+// Lexer spec of the language the parser reads, shared by main and by the
+// build step that compiles it into output/lexer_direct.c
+extern char* language_lexing_rules;
+extern int language_ignore_categories[];
+extern int language_ignore_count;
+
+// Category of the identifier rule. Keywords are scanned as identifiers and
+// told apart through a KeywordTable built from language_keywords.
+#define LANGUAGE_IDENTIFIER 14
+extern Keyword language_keywords[];
+extern int language_keyword_count;
+
+// Direct-coded longest match for language_lexing_rules, generated at build
+// time into output/lexer_direct.c by tools/genlexer. main lexes through it.
+int lexer_match(const char* src, size_t length, size_t start, size_t* end);
+
+#endif // LANGUAGE
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "dynarray.h"
+#include "re_pp.h"
+#include "subset.h"
+#include "scanner.h"
+#include "lazydfa.h"
+
+// Takes ownership of `nfa`. Only the initial state is built up front.
+LazyDFA* LDFA_create(FA nfa, size_t memory_budget){
+    LazyDFA* lazy = malloc(sizeof(LazyDFA));
+    lazy->nfa = nfa;
+    lazy->index = NFA_index_create(nfa);
+    lazy->memory_budget = memory_budget;
+    lazy->memory_used = 0;
+    lazy->flushes = 0;
+
+    int nfa_states = len_nfa_states(nfa);
+    lazy->nfa_category = malloc(nfa_states * sizeof(int));
+    for(int i = 0;i<nfa_states;i++){
+        lazy->nfa_category[i] = -1;
+    }
+    for(int i = 0;i<dynarray_length(nfa.acceptable_states);i++){
+        AcceptableState acc_state = nfa.acceptable_states[i];
+        if(acc_state.category > lazy->nfa_category[acc_state.state]){
+            lazy->nfa_category[acc_state.state] = acc_state.category;
+        }
+    }
+
+    lazy->states = dynarray_create(Subset);
+    lazy->states_set = SSS_create(SSS_DEFAULT_BUCKETS);
+    lazy->next = dynarray_create(int);
+    lazy->accept = dynarray_create(int);
+    lazy->scratch = SS_initialize_empty(nfa_states);
+
+    SS_clear(&lazy->scratch);
+    NFA_index_add_closure(&lazy->index, &lazy->scratch, nfa.initial_state);
+    LDFA_add_state(lazy, lazy->scratch);
+    return lazy;
+}
+
+void LDFA_destroy(LazyDFA* lazy){
+    for(int i = 0;i<dynarray_length(lazy->states);i++){
+        SS_destroy(&lazy->states[i]);
+    }
+    dynarray_destroy(lazy->states);
+    SSS_destroy(&lazy->states_set);
+    dynarray_destroy(lazy->next);
+    dynarray_destroy(lazy->accept);
+    SS_destroy(&lazy->scratch);
+    free(lazy->nfa_category);
+    NFA_index_destroy(&lazy->index);
+    FA_destroy(&lazy->nfa);
+    free(lazy);
+}
+
+// Bytes a cached state costs: its transition row, accept entry, subset and hash entry
+size_t LDFA_state_size(LazyDFA* lazy){
+    return DFA_TABLE_WIDTH * sizeof(int) + sizeof(int) + sizeof(Subset) + sizeof(IndexedSubset)
+        + lazy->scratch.word_count * sizeof(uint64_t);
+}
+
+// Caches a copy of `subset` as a new state. Its category is the highest one
+// among the accepting NFA states it holds, like in NtoDFA. A subset that is
+// already cached, such as the initial one right after a flush, keeps its index.
+int LDFA_add_state(LazyDFA* lazy, Subset subset){
+    Subset state = SS_deep_copy(subset);
+    int index = SSS_add(&lazy->states_set, state);
+    if(index != dynarray_length(lazy->states)){
+        SS_destroy(&state);
+        return index;
+    }
+    dynarray_push(lazy->states, state);
+
+    int unknown_row[DFA_TABLE_WIDTH];
+    for(int c = 0;c<DFA_TABLE_WIDTH;c++){
+        unknown_row[c] = LDFA_UNKNOWN;
+    }
+    dynarray_extend(lazy->next, unknown_row, DFA_TABLE_WIDTH);
+
+    int category = -1;
+    for(int s = SS_next(state, 0);s != -1;s = SS_next(state, s+1)){
+        if(lazy->nfa_category[s] == -1){
+            continue;
+        }
+        if(category == -1){
+            category = 0;
+        }
+        if(lazy->nfa_category[s] > category){
+            category = lazy->nfa_category[s];
+        }
+    }
+    dynarray_push(lazy->accept, category);
+
+    lazy->memory_used += LDFA_state_size(lazy);
+    return index;
+}
+
+// Drops every cached state and transition, then rebuilds the initial state
+void LDFA_flush(LazyDFA* lazy){
+    for(int i = 0;i<dynarray_length(lazy->states);i++){
+        SS_destroy(&lazy->states[i]);
+    }
+    _dynarray_field_set(lazy->states, LENGTH, 0);
+    _dynarray_field_set(lazy->next, LENGTH, 0);
+    _dynarray_field_set(lazy->accept, LENGTH, 0);
+    SSS_destroy(&lazy->states_set);
+    lazy->states_set = SSS_create(SSS_DEFAULT_BUCKETS);
+    lazy->memory_used = 0;
+    lazy->flushes++;
+
+    // Not built in `scratch`, LDFA_next still holds the pending target there
+    Subset initial = SS_initialize_empty(lazy->index.states_count);
+    NFA_index_add_closure(&lazy->index, &initial, lazy->nfa.initial_state);
+    LDFA_add_state(lazy, initial);
+    SS_destroy(&initial);
+}
+
+// Transition of `state` on `c`, determinized the first time it is taken.
+// A flush invalidates every state index but the one returned.
+int LDFA_next(LazyDFA* lazy, int state, char c){
+    if(state == LDFA_DEAD){
+        return LDFA_DEAD;
+    }
+
+    int slot = state * DFA_TABLE_WIDTH + (unsigned char) c;
+    if(lazy->next[slot] != LDFA_UNKNOWN){
+        return lazy->next[slot];
+    }
+
+    NFAIndex* index = &lazy->index;
+    Subset q = lazy->states[state];
+    SS_clear(&lazy->scratch);
+    for(int s = SS_next(q, 0);s != -1;s = SS_next(q, s+1)){
+        for(int j = index->edge_start[s];j<index->edge_start[s+1];j++){
+            int set = index->edge_set[j];
+            if(set == -1 ? index->edge_char[j] == c : BYTE_SET_IN(lazy->nfa.byte_sets[set], c)){
+                NFA_index_add_closure(index, &lazy->scratch, index->edge_to[j]);
+            }
+        }
+    }
+
+    if(lazy->scratch.count == 0){
+        lazy->next[slot] = LDFA_DEAD;
+        return LDFA_DEAD;
+    }
+
+    int target = SSS_index(&lazy->states_set, lazy->scratch);
+    if(target == -1){
+        if(lazy->memory_used + LDFA_state_size(lazy) > lazy->memory_budget){
+            LDFA_flush(lazy);
+            return LDFA_add_state(lazy, lazy->scratch);
+        }
+        target = LDFA_add_state(lazy, lazy->scratch);
+    }
+
+    lazy->next[slot] = target;
+    return target;
+}
+
+void scanner_lazy_emit(TokenStream* stream, size_t word_start, size_t word_length, int category, int* ignore_cats, int amount_ignore){
+    for(int i=0;i<amount_ignore;i++){
+        if(ignore_cats[i]==category){
+            return;
+        }
+    }
+
+    TokenSpan span;
+    span.offset = word_start;
+    span.length = (int) word_length;
+    span.category = category;
+    dynarray_push(stream->spans, span);
+}
+
+// Same stream as scanner_spans_buffer over a lazily built DFA. The last
+// accepting category is kept instead of the state, a flush may renumber it.
+TokenStream scanner_spans_lazy(LazyDFA* lazy, char* src, size_t length, int* ignore_cats, int amount_ignore){
+    int current_state = LDFA_INITIAL;
+    int last_category = -1;
+    size_t word_start = 0;
+
+    TokenStream stream;
+    stream.spans = dynarray_create(TokenSpan);
+    stream.pool = NULL;
+    stream.owns_source = false;
+
+    for(size_t i = 0;i<length;i++){
+        char c = src[i];
+
+        int next_state = LDFA_next(lazy, current_state, c);
+
+        if(next_state == LDFA_DEAD){
+            if(last_category != -1){
+                scanner_lazy_emit(&stream, word_start, i - word_start, last_category, ignore_cats, amount_ignore);
+
+                current_state = LDFA_next(lazy, LDFA_INITIAL, c);
+                last_category = -1;
+                if(current_state != LDFA_DEAD){
+                    last_category = lazy->accept[current_state];
+                }
+                word_start = i;
+            }
+            else{
+                scanner_report_error();
+                break;
+            }
+        }
+        else{
+            current_state = next_state;
+            if(lazy->accept[current_state] != -1){
+                last_category = lazy->accept[current_state];
+            }
+        }
+    }
+
+    if(last_category != -1){
+        scanner_lazy_emit(&stream, word_start, length - word_start, last_category, ignore_cats, amount_ignore);
+
+        TokenSpan final_span;
+        final_span.offset = 0;
+        final_span.length = 0;
+        final_span.category = 0;
+
+        dynarray_push(stream.spans, final_span);
+    }
+    else{
+        scanner_report_error();
+    }
+
+    stream.text = src;
+    return stream;
+}
+
+// Like MakeFA but stops at Thompson's construction, states are determinized while scanning
+LazyDFA* MakeLazyFA(char* src, size_t memory_budget, bool debug){
+    FA nfa;
+    FA_initialize(&nfa);
+
+    RegexToken* postfix = regex_to_postfix(src);
+    NFA_from_postfix(&nfa, postfix);
+    dynarray_destroy(postfix);
+
+    if(debug){
+        printf("\nlazy DFA over %zu NFA states, %zu byte budget\n", len_nfa_states(nfa), memory_budget);
+    }
+
+    return LDFA_create(nfa, memory_budget);
+}
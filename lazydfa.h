@@ -0,0 +1,44 @@
+#ifndef LAZYDFA
+#define LAZYDFA
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "subset.h"
+#include "scanner.h"
+
+#define LDFA_INITIAL 0
+#define LDFA_DEAD -1
+#define LDFA_UNKNOWN -2
+#define LDFA_DEFAULT_BUDGET (1 << 20)
+
+// DFA determinized from its NFA one transition at a time, as the scanner
+// reaches it. State s stands for the NFA subset states[s] and
+// next[s * DFA_TABLE_WIDTH + c] is its transition on c, LDFA_UNKNOWN until
+// first taken. When a new state would take memory_used past memory_budget
+// every state is dropped and the cache starts over from the initial one.
+typedef struct LazyDFA{
+    FA nfa;
+    NFAIndex index;
+    int* nfa_category;
+    Subset* states;
+    SubsetSet states_set;
+    int* next;
+    int* accept;
+    Subset scratch;
+    size_t memory_budget;
+    size_t memory_used;
+    int flushes;
+} LazyDFA;
+
+LazyDFA* LDFA_create(FA nfa, size_t memory_budget);
+void LDFA_destroy(LazyDFA* lazy);
+size_t LDFA_state_size(LazyDFA* lazy);
+int LDFA_add_state(LazyDFA* lazy, Subset subset);
+void LDFA_flush(LazyDFA* lazy);
+int LDFA_next(LazyDFA* lazy, int state, char c);
+
+TokenStream scanner_spans_lazy(LazyDFA* lazy, char* src, size_t length, int* ignore_cats, int amount_ignore);
+LazyDFA* MakeLazyFA(char* src, size_t memory_budget, bool debug);
+
+#endif // LAZYDFA
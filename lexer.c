@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "dynarray.h"
+#include "scanner.h"
+#include "source.h"
+#include "keywords.h"
+#include "lexer.h"
+
+// Only `dfa.table` and `dfa.initial_state` are set, the transition lists
+// the table was compiled from aren't needed to scan.
+struct Lexer{
+    FA dfa;
+    bool* ignored_states;
+    KeywordTable* keywords;
+};
+
+// Files of lexer_scan_files handed to one thread: directories[first],
+// directories[first + stride], ...
+typedef struct LexerJob{
+    const Lexer* lexer;
+    char** directories;
+    TokenStream* streams;
+    int file_count;
+    int first;
+    int stride;
+} LexerJob;
+
+// `dfa` is left untouched and can be destroyed right after. The keyword
+// table is skipped when keyword_count is 0.
+Lexer* lexer_create(FA dfa, int* ignore_cats, int amount_ignore, Keyword* keywords, int keyword_count, int identifier_category){
+    assert(dfa.table != NULL);
+    Lexer* lexer = malloc(sizeof(Lexer));
+    memset(&lexer->dfa, 0, sizeof(FA));
+    lexer->dfa.initial_state = dfa.initial_state;
+    lexer->dfa.table = DFA_table_copy(dfa.table);
+    lexer->ignored_states = DFA_table_ignored_states(lexer->dfa.table, ignore_cats, amount_ignore);
+    lexer->keywords = keyword_count > 0 ? keyword_table_create(keywords, keyword_count, identifier_category) : NULL;
+    return lexer;
+}
+
+void lexer_destroy(Lexer* lexer){
+    DFA_table_destroy(lexer->dfa.table);
+    free(lexer->ignored_states);
+    if(lexer->keywords != NULL){
+        keyword_table_destroy(lexer->keywords);
+    }
+    free(lexer);
+}
+
+// Longest match scan of `src`, see scanner_spans_munch. The spans point into `src`.
+TokenStream lexer_scan(const Lexer* lexer, char* src, size_t length){
+    TokenStream stream = scanner_munch_run(&lexer->dfa, src, length, lexer->ignored_states);
+    if(lexer->keywords != NULL){
+        token_stream_apply_keywords(&stream, lexer->keywords);
+    }
+    return stream;
+}
+
+// The spans point into the mapped file, which stays open until the stream is destroyed
+TokenStream lexer_scan_file(const Lexer* lexer, char* directory){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
+    scanner_check_utf8(source, directory);
+
+    TokenStream stream = lexer_scan(lexer, source.data, source.length);
+    stream.source = source;
+    stream.owns_source = true;
+    return stream;
+}
+
+void* lexer_job_run(void* arg){
+    LexerJob* job = arg;
+    for(int i = job->first;i<job->file_count;i += job->stride){
+        job->streams[i] = lexer_scan_file(job->lexer, job->directories[i]);
+    }
+    return NULL;
+}
+
+// One stream per file, in the order of `directories`. Files are dealt to
+// `thread_count` threads round robin, all of them reading the same lexer.
+TokenStream* lexer_scan_files(const Lexer* lexer, char** directories, int file_count, int thread_count){
+    TokenStream* streams = malloc(sizeof(TokenStream) * file_count);
+    if(thread_count > file_count){
+        thread_count = file_count;
+    }
+    if(thread_count < 1){
+        thread_count = 1;
+    }
+
+    LexerJob* jobs = malloc(sizeof(LexerJob) * thread_count);
+    for(int k = 0;k<thread_count;k++){
+        jobs[k].lexer = lexer;
+        jobs[k].directories = directories;
+        jobs[k].streams = streams;
+        jobs[k].file_count = file_count;
+        jobs[k].first = k;
+        jobs[k].stride = thread_count;
+    }
+
+#ifndef _WIN32
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    for(int k = 1;k<thread_count;k++){
+        pthread_create(&threads[k], NULL, lexer_job_run, &jobs[k]);
+    }
+    lexer_job_run(&jobs[0]);
+    for(int k = 1;k<thread_count;k++){
+        pthread_join(threads[k], NULL);
+    }
+    free(threads);
+#else
+    for(int k = 0;k<thread_count;k++){
+        lexer_job_run(&jobs[k]);
+    }
+#endif
+
+    free(jobs);
+    return streams;
+}
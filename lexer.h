@@ -0,0 +1,23 @@
+#ifndef LEXER
+#define LEXER
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "scanner.h"
+#include "keywords.h"
+
+// Compiled lexer: the DFA table, its ignored rows and the keyword table,
+// built once by lexer_create and never written again. Every scan keeps its
+// state on its own stack, so one handle can be shared by any number of
+// threads without copying or locking.
+typedef struct Lexer Lexer;
+
+Lexer* lexer_create(FA dfa, int* ignore_cats, int amount_ignore, Keyword* keywords, int keyword_count, int identifier_category);
+void lexer_destroy(Lexer* lexer);
+
+TokenStream lexer_scan(const Lexer* lexer, char* src, size_t length);
+TokenStream lexer_scan_file(const Lexer* lexer, char* directory);
+TokenStream* lexer_scan_files(const Lexer* lexer, char** directories, int file_count, int thread_count);
+
+#endif // LEXER
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "lexgen.h"
+
+void lexgen_case_label(unsigned char c, FILE* out){
+    if(isalnum(c) || c == '_'){
+        fprintf(out, "        case '%c':\n", c);
+    }
+    else{
+        fprintf(out, "        case %d:\n", c);
+    }
+}
+
+// Writes a standalone direct-coded scanner for `dfa`: one label per state,
+// each a switch over the next byte that jumps straight to the target state.
+// The generated `<prefix>_match` has the DirectMatch signature from
+// scanner.h and takes the longest match like scanner_munch_run: it runs
+// until the DFA dies and backs up to the last accept.
+void DFA_export_c(FA dfa, char* prefix, FILE* out){
+    DFATable* table = dfa.table;
+
+    fprintf(out, "// Generated from a %d state DFA, do not edit.\n", table->states_count);
+    fprintf(out, "#include <stddef.h>\n\n");
+    fprintf(out, "// Runs the lexer DFA from src[start] until no transition is left or the\n");
+    fprintf(out, "// input ends, then backs up to the last accepting state passed. Sets *end\n");
+    fprintf(out, "// past the longest token and returns its category, -1 if there was none.\n");
+    fprintf(out, "int %s_match(const char* src, size_t length, size_t start, size_t* end){\n", prefix);
+    fprintf(out, "    size_t i = start;\n");
+    fprintf(out, "    size_t accepted = start;\n");
+    fprintf(out, "    int category = -1;\n\n");
+    fprintf(out, "    goto state_%d;\n\n", dfa.initial_state);
+
+    bool* emitted = malloc(DFA_TABLE_WIDTH * sizeof(bool));
+    for(int s = 0;s<table->states_count;s++){
+        fprintf(out, "state_%d:\n", s);
+        // Tokens are never empty, reaching the initial state again is only
+        // an accept once a byte has been read
+        if(table->accept[s] != -1 && s == dfa.initial_state){
+            fprintf(out, "    if(i != start){\n");
+            fprintf(out, "        category = %d;\n", table->accept[s]);
+            fprintf(out, "        accepted = i;\n");
+            fprintf(out, "    }\n");
+        }
+        else if(table->accept[s] != -1){
+            fprintf(out, "    category = %d;\n", table->accept[s]);
+            fprintf(out, "    accepted = i;\n");
+        }
+        fprintf(out, "    if(i == length){\n");
+        fprintf(out, "        goto done;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    switch((unsigned char) src[i]){\n");
+
+        for(int b = 0;b<DFA_TABLE_WIDTH;b++){
+            emitted[b] = false;
+        }
+        for(int b = 0;b<DFA_TABLE_WIDTH;b++){
+            int target = DFA_table_next(table, s, b);
+            if(emitted[b] || target == table->dead_state){
+                continue;
+            }
+
+            for(int other = b;other<DFA_TABLE_WIDTH;other++){
+                if(!emitted[other] && DFA_table_next(table, s, other) == target){
+                    lexgen_case_label((unsigned char) other, out);
+                    emitted[other] = true;
+                }
+            }
+            fprintf(out, "            i++;\n");
+            fprintf(out, "            goto state_%d;\n", target);
+        }
+
+        fprintf(out, "        default:\n");
+        fprintf(out, "            goto done;\n");
+        fprintf(out, "    }\n\n");
+    }
+    free(emitted);
+
+    fprintf(out, "done:\n");
+    fprintf(out, "    *end = accepted;\n");
+    fprintf(out, "    return category;\n");
+    fprintf(out, "}\n");
+}
+
+bool DFA_export_c_file(FA dfa, char* prefix, char* out_dir){
+    FILE* out = fopen(out_dir, "w");
+    if(out == NULL){
+        return false;
+    }
+
+    DFA_export_c(dfa, prefix, out);
+    fclose(out);
+    return true;
+}
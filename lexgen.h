@@ -0,0 +1,13 @@
+#ifndef LEXGEN
+#define LEXGEN
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "scanner.h"
+
+void lexgen_case_label(unsigned char c, FILE* out);
+void DFA_export_c(FA dfa, char* prefix, FILE* out);
+bool DFA_export_c_file(FA dfa, char* prefix, char* out_dir);
+
+#endif // LEXGEN
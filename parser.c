@@ -10,6 +10,8 @@
 #include "scanner.h"
 #include "re_pp.h"
 #include "tree.h"
+#include "keywords.h"
+#include "language.h"
 
 #define DEFAULT_STACK_SIZE 3
 
@@ -52,7 +54,7 @@ typedef struct LRTransition{
 } LRTransition;
 
 typedef union StackItem{
-    Token token;
+    TokenSpan token;
     void* s_ptr;
     int s_int;
 } StackItem;
@@ -528,8 +530,13 @@ Item* item_closure(Grammar G, Item* s_raw, Subset* first){
         change = false;
         for(int i = 0;i<dynarray_length(s);i++){
             int curr_k = s[i].k;
-            int C = (*s[i].beta)[curr_k];
             int beta_length = dynarray_length(*s[i].beta);
+            // A completed item has its dot past the end of beta, there is
+            // no symbol after it to close over and beta[k] is out of bounds
+            if(curr_k >= beta_length){
+                continue;
+            }
+            int C = (*s[i].beta)[curr_k];
             for(int j = 0;j<dynarray_length(G.productions);j++){
                 if(G.productions[j].alpha == C){
 
@@ -638,59 +645,61 @@ TableMaterial c_collection(Grammar G, Subset* first){
     dynarray_push(CC, cc0);
     hash_add(HCC, cc0, hash_CC_item_equal);
 
+    SparseSet char_trans = SPS_initialize_empty(dynarray_length(G.T)+dynarray_length(G.NT));
+
     bool added_set = true;
     while(added_set){
         added_set = false;
         for(int i=0;i<dynarray_length(CC);i++){
             if(CC[i].marked == false){
-                Subset char_trans = SS_initialize_empty(dynarray_length(G.T)+dynarray_length(G.NT));
+                SPS_clear(&char_trans);
                 Item* current_cc = CC[i].cc;
                 CC[i].marked = true;
                 for(int j=0;j<dynarray_length(current_cc);j++){
                     int curr_k = current_cc[j].k;
                     int* curr_beta = *current_cc[j].beta;
                     if(curr_k<dynarray_length(curr_beta)){
-                        SS_add(&char_trans, curr_beta[curr_k]);
+                        SPS_add(&char_trans, curr_beta[curr_k]);
                     }
                 }
-
-                for(int j=0;j<char_trans.capacity;j++){
-                    if(char_trans.table[j]==true){
-                        Item* temp = goto_table(G, current_cc, first, j);
-                        CC_Item temp_item;
-                        LRTransition new_transition;
-                        new_transition.state_from = i;
-                        new_transition.trans_symbol = j;
-
-                        temp_item.cc = temp;
-                        temp_item.marked = false;
-                        temp_item.state = dynarray_length(CC);
-                        if(!hash_add(HCC, temp_item, hash_CC_item_equal)){
-                            new_transition.state_to = temp_item.state;
-                            added_set = true;
-                            dynarray_push(CC, temp_item);
-                        }
-                        else{
-                            void* stored_ptr = hash_get(HCC, temp_item, hash_CC_item_equal);
-                            if (stored_ptr != NULL) {
-                                CC_Item* stored_item = (CC_Item*) stored_ptr;
-                                new_transition.state_to = stored_item->state;
-                                //printf("Lengths: %d\n", dynarray_length(CC));
-                                //printf("Stored State: %d\n", stored_item->state);
-                            }
-
-                            dynarray_destroy(temp);
+                SPS_sort(&char_trans);
+
+                for(int c=0;c<char_trans.count;c++){
+                    int j = char_trans.dense[c];
+                    Item* temp = goto_table(G, current_cc, first, j);
+                    CC_Item temp_item;
+                    LRTransition new_transition;
+                    new_transition.state_from = i;
+                    new_transition.trans_symbol = j;
+
+                    temp_item.cc = temp;
+                    temp_item.marked = false;
+                    temp_item.state = dynarray_length(CC);
+                    if(!hash_add(HCC, temp_item, hash_CC_item_equal)){
+                        new_transition.state_to = temp_item.state;
+                        added_set = true;
+                        dynarray_push(CC, temp_item);
+                    }
+                    else{
+                        void* stored_ptr = hash_get(HCC, temp_item, hash_CC_item_equal);
+                        if (stored_ptr != NULL) {
+                            CC_Item* stored_item = (CC_Item*) stored_ptr;
+                            new_transition.state_to = stored_item->state;
+                            //printf("Lengths: %d\n", dynarray_length(CC));
+                            //printf("Stored State: %d\n", stored_item->state);
                         }
 
-                        dynarray_push(trans, new_transition);
+                        dynarray_destroy(temp);
                     }
-                }
 
-                SS_destroy(&char_trans);
+                    dynarray_push(trans, new_transition);
+                }
             }
         }
     }
 
+    SPS_destroy(&char_trans);
+
     //printf("OK OK OK?\n");
     //for(int i = 0;i<dynarray_length(CC);i++){
         //printf("---\n");
@@ -989,7 +998,9 @@ char** storage_table_from_mapping(Pair* mapping, int map_size){
 }
 
 
-TreeNode* parser_skeleton(Grammar G, TableMapping tb, Token* token_ptr, int extra_parameters, char** index_mapping){
+// Tree leaves point into the token stream's text, the stream has to outlive the tree
+TreeNode* parser_skeleton(Grammar G, TableMapping tb, TokenStream tokens, int extra_parameters, char** index_mapping){
+    TokenSpan* token_ptr = tokens.spans;
 
     StackItem* stack = dynarray_create(StackItem);
     //StackItem* token_bs = malloc((2+extra_parameters)*2*sizeof(StackItem));
@@ -1001,7 +1012,8 @@ TreeNode* parser_skeleton(Grammar G, TableMapping tb, Token* token_ptr, int extr
     first_state.s_int = 0;
 
     first_node.s_ptr = tree_make_node(0, "Root", NULL);
-    first_word.token.word = "";
+    first_word.token.offset = 0;
+    first_word.token.length = 0;
     first_word.token.category = END;
 
     dynarray_push(stack, first_node);
@@ -1029,7 +1041,8 @@ TreeNode* parser_skeleton(Grammar G, TableMapping tb, Token* token_ptr, int extr
             int* beta = G.productions[prod_rule].beta;
 
             StackItem new_token;
-            new_token.token.word = index_mapping[A];
+            new_token.token.offset = 0;
+            new_token.token.length = 0;
             new_token.token.category = A;
             
             TreeNode** children = malloc(dynarray_length(beta)*sizeof(TreeNode*));
@@ -1042,7 +1055,7 @@ TreeNode* parser_skeleton(Grammar G, TableMapping tb, Token* token_ptr, int extr
                 //print_node_info(children[i]);
             }
 
-            TreeNode* tmp_node = tree_make_node(dynarray_length(beta), new_token.token.word, children);
+            TreeNode* tmp_node = tree_make_node(dynarray_length(beta), index_mapping[A], children);
 
             //printf("TMP NODE");
             //print_node_info(tmp_node);
@@ -1078,14 +1091,13 @@ TreeNode* parser_skeleton(Grammar G, TableMapping tb, Token* token_ptr, int extr
             StackItem new_token;
             StackItem new_state;
 
-            TreeNode* tmp_node = tree_make_node(0, token_ptr->word, NULL);
+            TreeNode* tmp_node = tree_make_node_span(0, tokens.text + token_ptr->offset, token_ptr->length, NULL);
             
             //printf("TMP NODE");
             //print_node_info(tmp_node);
             
             new_node.s_ptr = tmp_node;
-            new_token.token.word = token_ptr->word;
-            new_token.token.category = token_ptr->category;
+            new_token.token = *token_ptr;
 
             new_state.s_int = to_state;
 
@@ -1285,7 +1297,7 @@ int main(){
     char* prod_rules_src = "grammar.k.specs";
     char* re_rules = "(([a-zA-Z/(/)/*///-/[/]+=?><.;{},:])([a-zA-Z/(/)/*///-/[/]+=?><.;{},:])*)$02|///|$03|(//->)$04|//;$05|(( |\n|\t|\r)( |\n|\t|\r)*)$01";
     
-    FA rules_regex = MakeFA(re_rules, "output/rules_dfa.txt", true);
+    FA rules_regex = MakeFA(re_rules, "output/rules_dfa.txt", true, FA_THOMPSON, true);
     FILE* file_rules_seq = fopen("output/rules_seq.txt", "w");
     
     Grammar G = build_grammar(rules_regex, prod_rules_src, dict_map, symbols_amount, file_rules_seq);
@@ -1331,32 +1343,34 @@ int main(){
     fclose(file_tables);
 
     // --- 6. LEXER EXECUTION ---
+    // The language lexer is compiled at build time into lexer_match
+    // (output/lexer_direct.c, written by tools/genlexer), so the rules in
+    // language.c are not turned into a DFA here
     char* file_dir = "languaje.k";
-    char* lexing_rules = "(=?)$19|(>=)$20|(<=)$21|(>)$22|(<)$23|+$07|-$08|/*$09|//$10|/($11|/)$12|/[$15|/]$16|.$17|,$18|(0|[1-9][0-9]*)$13|(\"([a-zA-Z0-9_][a-zA-Z0-9_]*)\")$24|(true)$25|(false)$26|(if)$32|(else)$33|(while)$34|(for)$35|(Init)$36|(Proc)$37|(return)$38|({)$39|(})$40|(;)$41|(<-)$42|(=)$43|(:)$44|(->)$45|(int)$46|(bool)$47|(float)$48|(break)$49|(continue)$50|(goto)$51|([a-zA-Z_][a-zA-Z0-9_]*)$14|(( |\n|\t|\r)( |\n|\t|\r)*)$01";
-    int ignore_categories[] = {1};
-
-    FA lexing_rules_regex = MakeFA(lexing_rules, "output/lexer_dfa.txt", true);
-    Token* scanner_out = scanner_loop_file(lexing_rules_regex, file_dir, ignore_categories, 1);
 
-    FA_destroy(&lexing_rules_regex);
+    TokenStream scanner_out = scanner_spans_file_direct(lexer_match, file_dir, language_ignore_categories, language_ignore_count);
+    KeywordTable* keywords = keyword_table_create(language_keywords, language_keyword_count, LANGUAGE_IDENTIFIER);
+    token_stream_apply_keywords(&scanner_out, keywords);
+    keyword_table_destroy(keywords);
 
-    print_token_seq(scanner_out);
+    print_token_stream(scanner_out);
     FILE* file_lexer_seq = fopen("output/lexer_seq.txt", "w");
-    export_token_seq(scanner_out, file_lexer_seq);
+    export_token_stream(scanner_out, file_lexer_seq);
     fclose(file_lexer_seq);
 
     // --- 7. PARSER EXECUTION ---
     TreeNode* root = parser_skeleton(G, tables_info, scanner_out, 0, value_map);
 
-    dynarray_destroy(scanner_out);
     destroy_tables(tables_info);
-    free(value_map);
-    dynadict_destroy(dict_map);
 
     if (root) {
         printf("\n--- Parse Tree ---\n");
         print_tree(root, "", true, true);
     }
 
+    token_stream_destroy(&scanner_out);
+    free(value_map);
+    dynadict_destroy(dict_map);
+
     return 0;
 }
\ No newline at end of file
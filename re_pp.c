@@ -14,80 +14,249 @@ enum CharClass classify(unsigned char c) {
     return OTHER;
 }
 
-char* regex_prep(char* raw_reg){
-    char* expanded_reg = dynarray_create(char);
-    int raw_reg_len = strnlen(raw_reg, MAX_REG);
-    bool should_expand = false;
+int byte_set_count(ByteSet set){
+    int count = 0;
+    for(int w = 0;w<4;w++){
+        count += __builtin_popcountll(set.bits[w]);
+    }
+    return count;
+}
 
-    char or_sign = '|';
-    for(int i = 0;i<raw_reg_len;i++){
-        enum CharClass c1 = classify(raw_reg[i-1]);
-        enum CharClass c2 = classify(raw_reg[i+1]);
+bool regex_is_codepoint_escape(char* regex, size_t regex_len, size_t i){
+    return regex[i] == '/' && i+2 < regex_len && regex[i+1] == 'u' && regex[i+2] == '{';
+}
 
-        bool lookahead_expand = false;
+// Reads the "/u{H}" or "/u{H-H}" escape at regex[i], H being a hexadecimal
+// codepoint, into [low, high] and returns the index of its closing '}'.
+size_t regex_codepoint_range(char* regex, size_t regex_len, size_t i, uint32_t* low, uint32_t* high){
+    assert(regex_is_codepoint_escape(regex, regex_len, i));
+    char* end;
+    *low = (uint32_t) strtoul(regex + i + 3, &end, 16);
+    assert(end != regex + i + 3);
+    *high = *low;
+    if(*end == '-'){
+        char* high_start = end + 1;
+        *high = (uint32_t) strtoul(high_start, &end, 16);
+        assert(end != high_start);
+    }
 
-        if((i+1)<raw_reg_len && raw_reg[i+1] == ']'){
-            lookahead_expand = true;
-        }
+    assert(*end == '}');
+    assert(*low <= *high);
+    assert(*high <= UTF8_MAX_CODEPOINT);
+    return (size_t) (end - regex);
+}
+
+// Reads the bracket expression opening at regex[i] into `set` and returns
+// the index of its closing ']'. Inside brackets "/x" is the byte x and "a-z"
+// spans two bytes of the same kind (digit, upper or lower case letter). A
+// "/u{...}" member adds its ASCII codepoints to `set` and appends the UTF-8
+// byte sequences of the rest to `sequences`, "/u/{" is the bytes 'u' and '{'.
+size_t regex_bracket_set(char* regex, size_t regex_len, size_t i, ByteSet* set, UTF8Sequence** sequences){
+    size_t open = i;
+    memset(set, 0, sizeof(ByteSet));
 
-        if(raw_reg[i] == '/'){
-            dynarray_push(expanded_reg, raw_reg[i]);
-            dynarray_push(expanded_reg, raw_reg[i+1]);
-            if(should_expand == true && ((i+2)<raw_reg_len && raw_reg[i+2] != ']')){
-                dynarray_push(expanded_reg, or_sign);
+    for(i = open + 1;i<regex_len && regex[i] != ']';i++){
+        if(regex_is_codepoint_escape(regex, regex_len, i)){
+            uint32_t low;
+            uint32_t high;
+            i = regex_codepoint_range(regex, regex_len, i, &low, &high);
+            for(uint32_t c = low;c <= high && c < 0x80;c++){
+                BYTE_SET_ADD(*set, c);
             }
+            if(high >= 0x80){
+                utf8_split_range(low < 0x80 ? 0x80 : low, high, sequences);
+            }
+        }
+        else if(regex[i] == '/'){
+            assert(i+1 < regex_len);
+            BYTE_SET_ADD(*set, regex[i+1]);
             i++;
-            continue;
         }
-        
-        if(raw_reg[i] == ']'){
-            should_expand = false;
+        else if(regex[i] == '-'){
+            assert(i-1 > open);
+            assert(i+1 < regex_len);
+            enum CharClass c1 = classify(regex[i-1]);
+            enum CharClass c2 = classify(regex[i+1]);
+            assert(c1 == c2);
+            assert(regex[i-1] < regex[i+1]);
+            assert(c1!=OTHER);
+            for(unsigned char c = (unsigned char) regex[i-1]+1; c < (unsigned char) regex[i+1]; c++){
+                BYTE_SET_ADD(*set, c);
+            }
         }
-        
-        if(should_expand == true){
-            if(raw_reg[i] == '-'){
-                assert((i-1)>=0);
-                assert((i+1)<raw_reg_len);
-                assert(c1 == c2);
-                assert(raw_reg[i-1] < raw_reg[i+1]);
-                assert(c1!=OTHER);
-                for (unsigned char c = (unsigned char) raw_reg[i-1]+1; c < (unsigned char) raw_reg[i+1]; c++) {
-                    char c_sign = (char) c;
-                    dynarray_push(expanded_reg, c_sign);
-                    if(lookahead_expand == false){
-                        dynarray_push(expanded_reg, or_sign);
-                    }
-                    
-                }
+        else{
+            BYTE_SET_ADD(*set, regex[i]);
+        }
+    }
+
+    assert(i < regex_len);
+    return i;
+}
+
+// Pops the operators on top of `operators` into `postfix` until an open
+// parenthesis, or one binding looser than `op` ('|' < '.') is on top.
+void regex_pop_operators(RegexToken** postfix, char* operators, char op){
+    while(dynarray_length(operators) > 0){
+        char top = operators[dynarray_length(operators) - 1];
+        if(top == '(' || (op == '.' && top == '|')){
+            break;
+        }
+
+        RegexToken token;
+        token.op = top == '|' ? RE_ALT : RE_CONCAT;
+        token.c = '\0';
+        token.category = 0;
+        dynarray_push(*postfix, token);
+        dynarray_pop(operators, &top);
+    }
+}
+
+// Operand matching the bytes in [low, high]
+RegexToken regex_byte_range_token(unsigned char low, unsigned char high){
+    RegexToken token;
+    token.op = low == high ? RE_CHAR : RE_SET;
+    token.c = (char) low;
+    token.category = 0;
+    memset(&token.set, 0, sizeof(ByteSet));
+    for(int b = low;b <= high;b++){
+        BYTE_SET_ADD(token.set, b);
+    }
+    return token;
+}
+
+// Pushes the alternation of `sequences`, each the concatenation of its byte
+// ranges, as one operand. With `alternate` it is also alternated with the
+// operand already on top of the output.
+void regex_push_sequences(RegexToken** postfix, UTF8Sequence* sequences, bool alternate){
+    RegexToken concat_token;
+    concat_token.op = RE_CONCAT;
+    concat_token.c = '\0';
+    concat_token.category = 0;
+    RegexToken alt_token = concat_token;
+    alt_token.op = RE_ALT;
+
+    for(int s = 0;s<dynarray_length(sequences);s++){
+        for(int b = 0;b<sequences[s].length;b++){
+            RegexToken range_token = regex_byte_range_token(sequences[s].low[b], sequences[s].high[b]);
+            dynarray_push(*postfix, range_token);
+            if(b > 0){
+                dynarray_push(*postfix, concat_token);
             }
-            else{
-                dynarray_push(expanded_reg, raw_reg[i]);
-                if(lookahead_expand == false){
-                    dynarray_push(expanded_reg, or_sign);
-                }
+        }
+        if(alternate || s > 0){
+            dynarray_push(*postfix, alt_token);
+        }
+    }
+}
+
+// Shunting-yard over the regex, one pass and no recursion. Adjacent operands
+// get an explicit concatenation. "*" and "$NN" are postfix already and apply
+// to the operand right before them, "/x" is the byte x. A bracket
+// expression is a single operand labelled with its whole byte set. A
+// "/u{...}" codepoint range, alone or in brackets, becomes the alternation
+// of the UTF-8 byte sequences encoding it, so scanning stays byte by byte.
+// "/u{" used to be the byte 'u' followed by '{', that is now "/u/{".
+RegexToken* regex_to_postfix(char* regex){
+    RegexToken* postfix = dynarray_create(RegexToken);
+    char* operators = dynarray_create(char);
+    size_t regex_len = strlen(regex);
+    bool operand_before = false;
+
+    for(size_t i = 0;i<regex_len;i++){
+        char c = regex[i];
+        RegexToken token;
+        token.c = '\0';
+        token.category = 0;
+
+        if(c == '*'){
+            token.op = RE_STAR;
+            dynarray_push(postfix, token);
+        }
+        else if(c == '$'){
+            assert(i+2 < regex_len);
+            char char_identifier[3] = {regex[i+1], regex[i+2], '\0'};
+            token.op = RE_TAG;
+            token.category = atoi(char_identifier);
+            dynarray_push(postfix, token);
+            i += 2;
+        }
+        else if(c == '|'){
+            regex_pop_operators(&postfix, operators, '|');
+            dynarray_push(operators, c);
+            operand_before = false;
+        }
+        else if(c == ')'){
+            regex_pop_operators(&postfix, operators, '|');
+            if(dynarray_length(operators) == 0){
+                printf("Parenthesis Mismatch -> -1");
             }
+            assert(dynarray_length(operators) > 0);
+            char open;
+            dynarray_pop(operators, &open);
+            operand_before = true;
         }
         else{
-            char add_char;
-            if(raw_reg[i] == '['){
-                add_char = '(';
+            if(operand_before){
+                char concat_sign = '.';
+                regex_pop_operators(&postfix, operators, concat_sign);
+                dynarray_push(operators, concat_sign);
             }
-            else if(raw_reg[i] == ']'){
-                add_char = ')';
+
+            if(c == '('){
+                dynarray_push(operators, c);
+                operand_before = false;
+                continue;
+            }
+
+            operand_before = true;
+            if(c == '[' || regex_is_codepoint_escape(regex, regex_len, i)){
+                UTF8Sequence* sequences = dynarray_create(UTF8Sequence);
+                int members = 0;
+                if(c == '['){
+                    i = regex_bracket_set(regex, regex_len, i, &token.set, &sequences);
+                    members = byte_set_count(token.set);
+                }
+                else{
+                    uint32_t low;
+                    uint32_t high;
+                    i = regex_codepoint_range(regex, regex_len, i, &low, &high);
+                    utf8_split_range(low, high, &sequences);
+                }
+                assert(members > 0 || dynarray_length(sequences) > 0);
+
+                if(members > 0){
+                    token.op = RE_SET;
+                    if(members == 1){
+                        token.op = RE_CHAR;
+                        for(int b = 0;b<256;b++){
+                            if(BYTE_SET_IN(token.set, b)){
+                                token.c = (char) b;
+                            }
+                        }
+                    }
+                    dynarray_push(postfix, token);
+                }
+                regex_push_sequences(&postfix, sequences, members > 0);
+                dynarray_destroy(sequences);
+                continue;
             }
-            else{
-                add_char = raw_reg[i];
+
+            token.op = RE_CHAR;
+            if(c == '/'){
+                assert(i+1 < regex_len);
+                c = regex[++i];
             }
-            dynarray_push(expanded_reg, add_char);
+            token.c = c;
+            dynarray_push(postfix, token);
         }
+    }
 
-        if(raw_reg[i] == '['){
-            should_expand = true;
-        }
-        
+    regex_pop_operators(&postfix, operators, '|');
+    if(dynarray_length(operators) != 0){
+        printf("Parenthesis Mismatch -> %d", (int) dynarray_length(operators));
     }
+    assert(dynarray_length(operators) == 0);
 
-    char null_char = '\0';
-    dynarray_push(expanded_reg, null_char);
-    return expanded_reg;
-}
\ No newline at end of file
+    dynarray_destroy(operators);
+    return postfix;
+}
@@ -1,7 +1,13 @@
+#ifndef RE_PP
+#define RE_PP
+
 #include <stdbool.h>  // For bool type
 #include <stddef.h>   // For size_t
+#include <stdint.h>   // For uint64_t
+#include "utf8.h"
 
-#define MAX_REG 512
+#define BYTE_SET_IN(set, b) (((set).bits[(unsigned char) (b) >> 6] >> ((unsigned char) (b) & 63)) & 1)
+#define BYTE_SET_ADD(set, b) ((set).bits[(unsigned char) (b) >> 6] |= (uint64_t) 1 << ((unsigned char) (b) & 63))
 
 // Enum for character classification
 enum CharClass {
@@ -14,5 +20,43 @@ enum CharClass {
 // Function to classify a character
 enum CharClass classify(unsigned char c);
 
-// Function to expand a regex pattern
-char* regex_prep(char* raw_reg);
+// Membership bitmap over the 256 byte values, the label of a bracket expression
+typedef struct ByteSet{
+    uint64_t bits[4];
+} ByteSet;
+
+// Operators of a regex once put in postfix order
+enum RegexOp {
+    RE_CHAR,
+    RE_SET,
+    RE_CONCAT,
+    RE_ALT,
+    RE_STAR,
+    RE_TAG
+};
+
+// RE_CHAR carries the byte to match, RE_SET the bytes of a bracket
+// expression and RE_TAG the category of its "$NN" suffix
+typedef struct RegexToken{
+    enum RegexOp op;
+    char c;
+    ByteSet set;
+    int category;
+} RegexToken;
+
+// Function to count the bytes in a byte set
+int byte_set_count(ByteSet set);
+
+// Function to tell if regex[i] opens a "/u{...}" codepoint escape
+bool regex_is_codepoint_escape(char* regex, size_t regex_len, size_t i);
+
+// Function to read a "/u{...}" codepoint escape
+size_t regex_codepoint_range(char* regex, size_t regex_len, size_t i, uint32_t* low, uint32_t* high);
+
+// Function to read a bracket expression into a byte set and UTF-8 sequences
+size_t regex_bracket_set(char* regex, size_t regex_len, size_t i, ByteSet* set, UTF8Sequence** sequences);
+
+// Function to turn a regex into postfix order
+RegexToken* regex_to_postfix(char* regex);
+
+#endif // RE_PP
@@ -3,10 +3,22 @@
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "dynarray.h"
 #include "re_pp.h"
 #include "subset.h"
 #include "scanner.h"
+#include "source.h"
+#include "dfacache.h"
+#include "utf8.h"
 
 
 void export_safe_char(char c, FILE* out) {
@@ -15,7 +27,14 @@ void export_safe_char(char c, FILE* out) {
         case '\t': fprintf(out, "\\t"); break;
         case '\r': fprintf(out, "\\r"); break;
         case ' ':  fprintf(out, "[SPC]"); break; // Or " " if you prefer
-        default:   fprintf(out, "%c", c);   break;
+        default:
+            if((unsigned char) c >= 0x80){
+                fprintf(out, "\\x%02X", (unsigned char) c); // UTF-8 lead or continuation byte
+            }
+            else{
+                fprintf(out, "%c", c);
+            }
+            break;
     }
 }
 
@@ -37,6 +56,31 @@ void export_transition(Transition t, FILE* out){
     fprintf(out, "\n");
 }
 
+void export_set_transition(Transition t, ByteSet set, FILE* out){
+    fprintf(out, "State: ");
+    fprintf(out, "%d ", t.state_from);
+    fprintf(out, "- [");
+    int b = 0;
+    while(b < 256){
+        if(!BYTE_SET_IN(set, b)){
+            b++;
+            continue;
+        }
+        int low = b;
+        while(b < 256 && BYTE_SET_IN(set, b)){
+            b++;
+        }
+        export_safe_char((char) low, out);
+        if(b - 1 > low){
+            fprintf(out, "-");
+            export_safe_char((char) (b - 1), out);
+        }
+    }
+    fprintf(out, "] -> State: ");
+    fprintf(out, "%d", t.state_to);
+    fprintf(out, "\n");
+}
+
 void FA_export(FA fa, FILE* out){
     fprintf(out, "-- States --\n");
     for(int i = 0; i < dynarray_length(fa.states);i++){
@@ -58,7 +102,12 @@ void FA_export(FA fa, FILE* out){
     fprintf(out, "\n");
     //printf("-- Transitions --\n");
     for(int i = 0; i < dynarray_length(fa.transitions);i++){
-        export_transition(fa.transitions[i], out);
+        if(fa.transitions[i].byte_set != -1){
+            export_set_transition(fa.transitions[i], fa.byte_sets[fa.transitions[i].byte_set], out);
+        }
+        else{
+            export_transition(fa.transitions[i], out);
+        }
     }
 
     fprintf(out, "-- Starting State --\n");
@@ -87,10 +136,22 @@ void export_token_seq(Token* tokens, FILE* out){
     }
 }
 
+void print_token_stream(TokenStream stream){
+    export_token_stream(stream, stdout);
+}
+
+void export_token_stream(TokenStream stream, FILE* out){
+    for(int i = 0;i<dynarray_length(stream.spans);i++){
+        fprintf(out, "(%.*s, %d)\n", stream.spans[i].length, token_stream_word(stream, i), stream.spans[i].category);
+    }
+}
+
 int FA_initialize(FA *fa){
     fa->states = dynarray_create(int);
     fa->transitions = dynarray_create(Transition);
     fa->acceptable_states = dynarray_create(AcceptableState);
+    fa->byte_sets = dynarray_create(ByteSet);
+    fa->table = NULL;
     memset(fa->alphabet, 0, 256);
 }
 
@@ -101,40 +162,37 @@ int FA_next_state(FA *fa){
     return next_int;
 }
 
-bool int_dynarray_in(int* arr, int search){
-    for(int i = 0;i<dynarray_length(arr);i++){
-        if(arr[i] == search){
-            return true;
-        }
-    }
-    return false;
-}
-
 void FA_destroy(FA *fa){
     dynarray_destroy(fa->states);
     dynarray_destroy(fa->transitions);
     dynarray_destroy(fa->acceptable_states);
+    dynarray_destroy(fa->byte_sets);
+    if(fa->table != NULL){
+        DFA_table_destroy(fa->table);
+        fa->table = NULL;
+    }
 }
 
-bool FA_valid_state(FA fa, int state_check){
-    return int_dynarray_in(fa.states, state_check);
-}
-
+// States are only ever created by FA_next_state, so `states` always holds
+// 0 .. n-1 and a bounds check is as good as searching it
 bool FA_fast_valid_state(FA fa, int state_check){
-    return (state_check < dynarray_length(fa.states));
+    return state_check >= 0 && state_check < dynarray_length(fa.states);
 }
 
 void FA_add_acceptable_state(FA *fa, int acceptable_state, int category){
-    assert(FA_valid_state(*fa, acceptable_state));
+    assert(FA_fast_valid_state(*fa, acceptable_state));
     AcceptableState acc_state;
     acc_state.state = acceptable_state;
     acc_state.category = category;
     dynarray_push(fa->acceptable_states, acc_state);
 }
 
-bool FA_state_is_acceptable(FA fa, int state){
-    for(int i = 0;i<dynarray_length(fa.acceptable_states);i++){
-        if(fa.acceptable_states[i].state == state){
+bool FA_state_is_acceptable(const FA* fa, int state){
+    if(fa->table != NULL){
+        return fa->table->accept[state] != -1;
+    }
+    for(int i = 0;i<dynarray_length(fa->acceptable_states);i++){
+        if(fa->acceptable_states[i].state == state){
             return true;
         }
     }
@@ -146,12 +204,13 @@ int acceptable_states_mapping(char* c){
 }
 
 Transition NFA_add_transition(FA *nfa, int _from, int _to, char _trans_char){
-    assert(FA_valid_state(*nfa, _from));
-    assert(FA_valid_state(*nfa, _to));
+    assert(FA_fast_valid_state(*nfa, _from));
+    assert(FA_fast_valid_state(*nfa, _to));
     Transition trans;
     trans.state_from = _from;
     trans.state_to = _to;
     trans.trans_char = _trans_char;
+    trans.byte_set = -1;
     dynarray_push(nfa->transitions, trans);
 
     if(_trans_char != EPSILON){
@@ -162,685 +221,2178 @@ Transition NFA_add_transition(FA *nfa, int _from, int _to, char _trans_char){
     return trans;
 }
 
-Transition DFA_add_transition(FA *dfa, int _from, int _to, char _trans_char){
-    assert(FA_valid_state(*dfa, _from));
-    assert(FA_valid_state(*dfa, _to));
+// Stores `set` for set edges to index and adds its bytes to the alphabet
+int FA_add_byte_set(FA *fa, ByteSet set){
+    int set_index = dynarray_length(fa->byte_sets);
+    dynarray_push(fa->byte_sets, set);
+
+    for(int b = 0;b<256;b++){
+        if(BYTE_SET_IN(set, b)){
+            fa->alphabet[b] = 1;
+        }
+    }
+
+    return set_index;
+}
+
+// One edge for every byte in `set`, instead of an alternation of single byte edges
+Transition NFA_add_set_transition(FA *nfa, int _from, int _to, ByteSet set){
+    assert(FA_fast_valid_state(*nfa, _from));
+    assert(FA_fast_valid_state(*nfa, _to));
     Transition trans;
     trans.state_from = _from;
     trans.state_to = _to;
-    trans.trans_char = _trans_char;
+    trans.trans_char = '\0';
+    trans.byte_set = FA_add_byte_set(nfa, set);
+    dynarray_push(nfa->transitions, trans);
 
-    for(int i = 0;i<dynarray_length(dfa->transitions);i++){
-        assert(!(dfa->transitions[i].state_from == _from && dfa->transitions[i].trans_char == _trans_char));
-    }
-    dynarray_push(dfa->transitions, trans);
+    return trans;
+}
 
-    if(_trans_char != EPSILON){
-        int int_repr = (unsigned char) _trans_char;
-        dfa->alphabet[int_repr] = 1;
+// Edge carrying the same label as `label`, a set edge shares its byte set
+Transition NFA_add_labelled_transition(FA *nfa, int _from, int _to, Transition label){
+    if(label.byte_set == -1){
+        return NFA_add_transition(nfa, _from, _to, label.trans_char);
     }
 
+    assert(FA_fast_valid_state(*nfa, _from));
+    assert(FA_fast_valid_state(*nfa, _to));
+    Transition trans = label;
+    trans.state_from = _from;
+    trans.state_to = _to;
+    dynarray_push(nfa->transitions, trans);
+
     return trans;
 }
 
-
-int altercation(Fragment *left_fragment, Fragment *right_fragment, int *priority, int depth, int i){
-    if(ALT_PRIORITY < *priority && depth == 0){
-        left_fragment->end_index = i;
-        right_fragment->start_index = i+1;
-        *priority = ALT_PRIORITY;
-        return true;
-    }
-    return false;
+void DFA_builder_init(DFABuilder* builder){
+    FA_initialize(&builder->dfa);
+    builder->rows = dynarray_create(int);
 }
 
-int concatenation(Fragment fragment, Fragment *left_fragment, Fragment *right_fragment, int *priority, int depth, int i, char next_char, char prev_char){
-    if(CONCAT_PRIORITY < *priority && depth == 0){
-        if(i >= fragment.start_index+1){
-            left_fragment->end_index = i;
-            right_fragment->start_index = i;
-            *priority = CONCAT_PRIORITY;
-            return true;
-        }
-        //im really unsure about this but lets roll
-        //else{
-            //if(next_char != '\0' && next_char != '*' && next_char != '$'){
-                //left_fragment->end_index = i+1;
-                //right_fragment->start_index = i+1;
-                //*priority = CONCAT_PRIORITY;
-                //return true;
-            //} 
-        //}
+int DFA_builder_add_state(DFABuilder* builder){
+    int empty_row[DFA_TABLE_WIDTH];
+    for(int c = 0;c<DFA_TABLE_WIDTH;c++){
+        empty_row[c] = -1;
     }
-    return false;
-}
+    dynarray_extend(builder->rows, empty_row, DFA_TABLE_WIDTH);
 
-int closure(Fragment fragment, Fragment *left_fragment, Fragment *right_fragment, int *priority, bool *final_split, int depth, bool split_found, int pass_priority, int i){
-    if(pass_priority <= *priority && depth == 0 && i == fragment.end_index-1){
-        left_fragment->end_index = i;
-        *final_split = true;
-        *priority = pass_priority;
-        return true;
-    }
-    return false;
+    return FA_next_state(&builder->dfa);
 }
 
-int fin_type(Fragment fragment, Fragment *left_fragment, Fragment *right_fragment, int *priority, bool *final_split, char* state_identifier, char next_char, int depth, int i){
-    if(FIN_PRIORITY <= *priority && depth == 0 && i == fragment.end_index-3){
-        left_fragment->end_index = i;
-        *final_split = true;
-        *priority = FIN_PRIORITY;
-        *state_identifier = next_char;
-        return true;
+// A state has at most one transition per byte, checked with a single lookup
+void DFA_builder_add_transition(DFABuilder* builder, int _from, int _to, char _trans_char){
+    assert(FA_fast_valid_state(builder->dfa, _from));
+    assert(FA_fast_valid_state(builder->dfa, _to));
+    int* slot = &builder->rows[_from * DFA_TABLE_WIDTH + (unsigned char) _trans_char];
+    assert(*slot == -1);
+    *slot = _to;
+
+    if(_trans_char != EPSILON){
+        builder->dfa.alphabet[(unsigned char) _trans_char] = 1;
     }
-    return false;
 }
 
-int parenthesis(Fragment fragment, Fragment *left_fragment, bool *final_split, bool split_found, int i){
-    if(i == fragment.end_index-1 && split_found == false){
-        left_fragment->start_index += 1;
-        left_fragment->end_index = i;
-        *final_split = true;
-        return true;
-    }
-    return false;
+void DFA_builder_add_acceptable_state(DFABuilder* builder, int acceptable_state, int category){
+    FA_add_acceptable_state(&builder->dfa, acceptable_state, category);
 }
 
-Fragment find_split_point(FA* nfa, char* str, Fragment fragment, int final_state, bool recursion, bool debug){
-    Fragment left_fragment = {fragment.start_index, fragment.start_index};
-    Fragment right_fragment = {fragment.end_index, fragment.end_index};
+// Turns the rows into the transition list and the compressed table in a
+// single walk and hands over the DFA. The builder is spent afterwards.
+FA DFA_builder_finish(DFABuilder* builder, int initial_state){
+    FA dfa = builder->dfa;
+    dfa.initial_state = initial_state;
+
+    int states_count = dynarray_length(dfa.states);
+    size_t cells = (size_t) states_count * DFA_TABLE_WIDTH;
+    int* next = malloc((cells + DFA_TABLE_WIDTH) * sizeof(int));
+    for(size_t i = 0;i<cells;i++){
+        int target = builder->rows[i];
+        if(target == -1){
+            next[i] = states_count;
+            continue;
+        }
 
-    int min_priority = MAX_PRIORITY;
-    int parenthesis_depth = 0;
+        next[i] = target;
+        Transition trans;
+        trans.state_from = (int) (i / DFA_TABLE_WIDTH);
+        trans.state_to = target;
+        trans.trans_char = (char) (i % DFA_TABLE_WIDTH);
+        trans.byte_set = -1;
+        dynarray_push(dfa.transitions, trans);
+    }
+    for(int c = 0;c<DFA_TABLE_WIDTH;c++){
+        next[cells + c] = states_count;
+    }
+    dynarray_destroy(builder->rows);
 
-    bool final_split = false;
-    bool split_found = false;
-    bool found_solution = false;
+    dfa.table = DFA_table_from_rows(next, states_count, dfa.acceptable_states);
+    DFA_table_compress(dfa.table);
+    return dfa;
+}
 
-    char acc_state_identifier = '\0';
 
-    if(debug){
-        for(int i = fragment.start_index;i<fragment.end_index;i++){
-            print_safe_char(str[i]);
+void regex_postfix_print(RegexToken* postfix){
+    for(int i = 0;i<dynarray_length(postfix);i++){
+        switch(postfix[i].op){
+            case RE_CHAR:
+                print_safe_char(postfix[i].c);
+                break;
+            case RE_SET:
+                printf("[set]");
+                break;
+            case RE_CONCAT:
+                printf(".");
+                break;
+            case RE_ALT:
+                printf("|");
+                break;
+            case RE_STAR:
+                printf("*");
+                break;
+            case RE_TAG:
+                printf("$%02d", postfix[i].category);
+                break;
         }
-        printf("\n");
+        printf(" ");
     }
+    printf("\n");
+}
 
-    if(fragment.start_index == fragment.end_index-1){
-        int state_head = FA_next_state(nfa);
-        int state_tail = FA_next_state(nfa);
-
-        if(final_state > 0){
-            FA_add_acceptable_state(nfa, state_tail, final_state);
+// Thompson's construction over a regex in postfix order, with a stack of
+// fragments (head and tail state of each sub-automaton) instead of recursion.
+// A "$NN" tag marks the tail of the fragment on top as accepting category NN,
+// "$00" tags nothing.
+Fragment NFA_from_postfix(FA* nfa, RegexToken* postfix){
+    Fragment* fragments = dynarray_create(Fragment);
+
+    for(int i = 0;i<dynarray_length(postfix);i++){
+        RegexToken token = postfix[i];
+        Fragment left_fragment;
+        Fragment right_fragment;
+        Fragment new_fragment;
+
+        switch(token.op){
+            case RE_CHAR:
+                new_fragment.start_index = FA_next_state(nfa);
+                new_fragment.end_index = FA_next_state(nfa);
+                NFA_add_transition(nfa, new_fragment.start_index, new_fragment.end_index, token.c);
+                break;
+            case RE_SET:
+                new_fragment.start_index = FA_next_state(nfa);
+                new_fragment.end_index = FA_next_state(nfa);
+                NFA_add_set_transition(nfa, new_fragment.start_index, new_fragment.end_index, token.set);
+                break;
+            case RE_STAR:
+                assert(dynarray_length(fragments) >= 1);
+                dynarray_pop(fragments, &left_fragment);
+                new_fragment.start_index = FA_next_state(nfa);
+                new_fragment.end_index = FA_next_state(nfa);
+
+                NFA_add_transition(nfa, new_fragment.start_index, left_fragment.start_index, EPSILON);
+                NFA_add_transition(nfa, left_fragment.end_index, new_fragment.end_index, EPSILON);
+                NFA_add_transition(nfa, left_fragment.end_index, left_fragment.start_index, EPSILON);
+                NFA_add_transition(nfa, new_fragment.start_index, new_fragment.end_index, EPSILON);
+                break;
+            case RE_TAG:
+                assert(dynarray_length(fragments) >= 1);
+                dynarray_pop(fragments, &new_fragment);
+                if(token.category > 0){
+                    FA_add_acceptable_state(nfa, new_fragment.end_index, token.category);
+                }
+                break;
+            case RE_ALT:
+                assert(dynarray_length(fragments) >= 2);
+                dynarray_pop(fragments, &right_fragment);
+                dynarray_pop(fragments, &left_fragment);
+                new_fragment.start_index = FA_next_state(nfa);
+                new_fragment.end_index = FA_next_state(nfa);
+
+                NFA_add_transition(nfa, new_fragment.start_index, left_fragment.start_index, EPSILON);
+                NFA_add_transition(nfa, new_fragment.start_index, right_fragment.start_index, EPSILON);
+                NFA_add_transition(nfa, left_fragment.end_index, new_fragment.end_index, EPSILON);
+                NFA_add_transition(nfa, right_fragment.end_index, new_fragment.end_index, EPSILON);
+                break;
+            case RE_CONCAT:
+                assert(dynarray_length(fragments) >= 2);
+                dynarray_pop(fragments, &right_fragment);
+                dynarray_pop(fragments, &left_fragment);
+                NFA_add_transition(nfa, left_fragment.end_index, right_fragment.start_index, EPSILON);
+                new_fragment.start_index = left_fragment.start_index;
+                new_fragment.end_index = right_fragment.end_index;
+                break;
         }
-        Transition trans = NFA_add_transition(nfa, state_head, state_tail, str[fragment.start_index]);
-        Fragment char_fragment = {state_head, state_tail};
 
-        nfa->initial_state = state_head;
-        return char_fragment;
+        dynarray_push(fragments, new_fragment);
     }
-    else if(fragment.start_index == fragment.end_index-2 && str[fragment.start_index] == '/'){
-        int state_head = FA_next_state(nfa);
-        int state_tail = FA_next_state(nfa);
 
-        if(final_state > 0){
-            FA_add_acceptable_state(nfa, state_tail, final_state);
-        }
-        Transition trans = NFA_add_transition(nfa, state_head, state_tail, str[fragment.start_index+1]);
-        Fragment char_fragment = {state_head, state_tail};
+    assert(dynarray_length(fragments) == 1);
+    Fragment nfa_fragment = fragments[0];
+    nfa->initial_state = nfa_fragment.start_index;
 
-        nfa->initial_state = state_head;
-        return char_fragment;
-    }
-    else{
-        for(int i = fragment.start_index;i<fragment.end_index;i++){
-            char current_char = str[i];
-            char previous_char;
-            char following_char;
-            if(i == 0){
-                previous_char = '\0';
-            }
-            else{
-                previous_char = str[i-1];
-            }
+    dynarray_destroy(fragments);
+    return nfa_fragment;
+}
 
-            if(i == fragment.end_index-1){
-                following_char = '\0';
-            }
-            else{
-                following_char = str[i+1];
-            }
+void glushkov_fragment_destroy(GlushkovFragment* fragment){
+    dynarray_destroy(fragment->first);
+    dynarray_destroy(fragment->last);
+    dynarray_destroy(fragment->tags);
+}
 
-            if(current_char == '|'){
-                found_solution = altercation(&left_fragment, &right_fragment, &min_priority, parenthesis_depth, i);
-            }
-            else if(current_char == '*'){
-                found_solution = closure(fragment, &left_fragment, &right_fragment, &min_priority, &final_split, parenthesis_depth, split_found, CLOS_PRIORITY, i);
-            }
-            else if(current_char == '$'){
-                found_solution = fin_type(fragment, &left_fragment, &right_fragment, &min_priority, &final_split, &acc_state_identifier, following_char, parenthesis_depth, i);
-                i += 2;
-            }
-            else if(current_char == '('){
-                found_solution = concatenation(fragment, &left_fragment, &right_fragment, &min_priority, parenthesis_depth, i, '\0', previous_char);
-                parenthesis_depth += 1;
-            }
-            else if(current_char == ')'){
-                parenthesis_depth -= 1;
-                found_solution = parenthesis(fragment, &left_fragment, &final_split, split_found, i);
-            }
-            else if(current_char == '/'){
-                found_solution = concatenation(fragment, &left_fragment, &right_fragment, &min_priority, parenthesis_depth, i, following_char, previous_char);
-                i++;
-            }
-            else{
-                found_solution = concatenation(fragment, &left_fragment, &right_fragment, &min_priority, parenthesis_depth, i, following_char, previous_char);
-            }
+// Position (Glushkov) automaton over a regex in postfix order. State 0 is the
+// initial state and every RE_CHAR or RE_SET operand is a state of its own,
+// entered on the operand's label, so no epsilon edge is ever created.
+// Concatenation and closure link the last positions of one fragment to the
+// first positions of the next. A "$NN" tag marks the last positions of the
+// fragment on top as accepting category NN, and when the fragment can match
+// the empty word it is also kept in `tags` for whatever position ends up
+// right before the fragment.
+void NFA_glushkov_from_postfix(FA* nfa, RegexToken* postfix){
+    GlushkovFragment* fragments = dynarray_create(GlushkovFragment);
+    // Label of the edges entering each position, indexed by state
+    Transition* labels = dynarray_create(Transition);
+
+    nfa->initial_state = FA_next_state(nfa);
+    Transition no_label = {0, 0, EPSILON, -1};
+    dynarray_push(labels, no_label);
+
+    for(int i = 0;i<dynarray_length(postfix);i++){
+        RegexToken token = postfix[i];
+        GlushkovFragment left_fragment;
+        GlushkovFragment right_fragment;
+        GlushkovFragment new_fragment;
+
+        switch(token.op){
+            case RE_CHAR:
+            case RE_SET:
+                {
+                    int position = FA_next_state(nfa);
+                    Transition label = no_label;
+                    label.state_to = position;
+                    if(token.op == RE_CHAR){
+                        label.trans_char = token.c;
+                        if(token.c != EPSILON){
+                            nfa->alphabet[(unsigned char) token.c] = 1;
+                        }
+                    }
+                    else{
+                        label.trans_char = '\0';
+                        label.byte_set = FA_add_byte_set(nfa, token.set);
+                    }
+                    dynarray_push(labels, label);
+
+                    new_fragment.nullable = false;
+                    new_fragment.first = dynarray_create(int);
+                    new_fragment.last = dynarray_create(int);
+                    new_fragment.tags = dynarray_create(int);
+                    dynarray_push(new_fragment.first, position);
+                    dynarray_push(new_fragment.last, position);
+                }
+                break;
+            case RE_STAR:
+                assert(dynarray_length(fragments) >= 1);
+                dynarray_pop(fragments, &new_fragment);
+                for(int l = 0;l<dynarray_length(new_fragment.last);l++){
+                    int p = new_fragment.last[l];
+                    for(int f = 0;f<dynarray_length(new_fragment.first);f++){
+                        NFA_add_labelled_transition(nfa, p, new_fragment.first[f], labels[new_fragment.first[f]]);
+                    }
+                    for(int t = 0;t<dynarray_length(new_fragment.tags);t++){
+                        FA_add_acceptable_state(nfa, p, new_fragment.tags[t]);
+                    }
+                }
+                new_fragment.nullable = true;
+                break;
+            case RE_TAG:
+                assert(dynarray_length(fragments) >= 1);
+                dynarray_pop(fragments, &new_fragment);
+                if(token.category > 0){
+                    for(int l = 0;l<dynarray_length(new_fragment.last);l++){
+                        FA_add_acceptable_state(nfa, new_fragment.last[l], token.category);
+                    }
+                    if(new_fragment.nullable){
+                        dynarray_push(new_fragment.tags, token.category);
+                    }
+                }
+                break;
+            case RE_ALT:
+                assert(dynarray_length(fragments) >= 2);
+                dynarray_pop(fragments, &right_fragment);
+                dynarray_pop(fragments, &left_fragment);
+                new_fragment = left_fragment;
+                new_fragment.nullable = left_fragment.nullable || right_fragment.nullable;
+                dynarray_extend(new_fragment.first, right_fragment.first, dynarray_length(right_fragment.first));
+                dynarray_extend(new_fragment.last, right_fragment.last, dynarray_length(right_fragment.last));
+                dynarray_extend(new_fragment.tags, right_fragment.tags, dynarray_length(right_fragment.tags));
+                glushkov_fragment_destroy(&right_fragment);
+                break;
+            case RE_CONCAT:
+                assert(dynarray_length(fragments) >= 2);
+                dynarray_pop(fragments, &right_fragment);
+                dynarray_pop(fragments, &left_fragment);
+                for(int l = 0;l<dynarray_length(left_fragment.last);l++){
+                    int p = left_fragment.last[l];
+                    for(int f = 0;f<dynarray_length(right_fragment.first);f++){
+                        NFA_add_labelled_transition(nfa, p, right_fragment.first[f], labels[right_fragment.first[f]]);
+                    }
+                    for(int t = 0;t<dynarray_length(right_fragment.tags);t++){
+                        FA_add_acceptable_state(nfa, p, right_fragment.tags[t]);
+                    }
+                }
 
-            if(found_solution > 0){
-                split_found = true;
-            }
+                new_fragment = left_fragment;
+                new_fragment.nullable = left_fragment.nullable && right_fragment.nullable;
+                if(left_fragment.nullable){
+                    dynarray_extend(new_fragment.first, right_fragment.first, dynarray_length(right_fragment.first));
+                    dynarray_extend(new_fragment.tags, right_fragment.tags, dynarray_length(right_fragment.tags));
+                }
+                if(!right_fragment.nullable){
+                    _dynarray_field_set(new_fragment.last, LENGTH, 0);
+                }
+                dynarray_extend(new_fragment.last, right_fragment.last, dynarray_length(right_fragment.last));
+                glushkov_fragment_destroy(&right_fragment);
+                break;
+        }
+
+        dynarray_push(fragments, new_fragment);
     }
+
+    assert(dynarray_length(fragments) == 1);
+    GlushkovFragment regex_fragment = fragments[0];
+    for(int f = 0;f<dynarray_length(regex_fragment.first);f++){
+        NFA_add_labelled_transition(nfa, nfa->initial_state, regex_fragment.first[f], labels[regex_fragment.first[f]]);
     }
-    
-    if (parenthesis_depth != 0){
-        printf("Parenthesis Mismatch -> %d", parenthesis_depth);
-        Fragment error_fragment = {0, 0};
+    for(int t = 0;t<dynarray_length(regex_fragment.tags);t++){
+        FA_add_acceptable_state(nfa, nfa->initial_state, regex_fragment.tags[t]);
     }
 
-    assert(parenthesis_depth == 0);
-
-    //printf("(%d, %d) (%d, %d)\n",left_fragment.start_index, left_fragment.end_index, right_fragment.start_index, left_fragment.end_index);
-
-    if(recursion == true){
-        if(final_split == true){
-            switch(min_priority){
-                case CLOS_PRIORITY:
-                    Fragment nfa_only_fragment = find_split_point(nfa, str, left_fragment, 0, true, debug);
-
-                    int state_head_alt = FA_next_state(nfa);
-                    int state_tail_alt = FA_next_state(nfa);
-                    
-                    Transition trans_start = NFA_add_transition(nfa, state_head_alt, nfa_only_fragment.start_index, EPSILON);
-                    Transition trans_tail = NFA_add_transition(nfa, nfa_only_fragment.end_index, state_tail_alt, EPSILON);
-                    Transition trans_ret = NFA_add_transition(nfa, nfa_only_fragment.end_index, nfa_only_fragment.start_index, EPSILON);
-                    Transition trans_bounce = NFA_add_transition(nfa, state_head_alt, state_tail_alt, EPSILON);
-
-                    Fragment alt_fragment = {state_head_alt, state_tail_alt};
-
-                    if(final_state > 0){
-                        FA_add_acceptable_state(nfa, state_tail_alt, final_state);
-                    }
+    glushkov_fragment_destroy(&regex_fragment);
+    dynarray_destroy(fragments);
+    dynarray_destroy(labels);
+}
 
-                    nfa->initial_state = state_head_alt;
-                    return alt_fragment;
-                case FIN_PRIORITY:
-                    char char_identifier[3];
-
-                    char_identifier[0] = str[left_fragment.end_index+1];
-                    char_identifier[1] = str[left_fragment.end_index+2];
-                    char_identifier[2] = '\0';
-                    int num_state_identifier = acceptable_states_mapping(char_identifier);
-                    Fragment final_tag_fragment = find_split_point(nfa, str, left_fragment, num_state_identifier, true, debug);
-                    return final_tag_fragment;
-                case MAX_PRIORITY:
-                    Fragment same_fragment = find_split_point(nfa, str, left_fragment, 0, true, debug);
-                    if(final_state > 0){
-                        FA_add_acceptable_state(nfa, same_fragment.end_index, final_state);
-                    }
-                    return same_fragment;
-                default:
-                    printf("Something is not right");
-            }
+NFAIndex NFA_index_create(FA nfa){
+    NFAIndex index;
+    int n = len_nfa_states(nfa);
+    int transitions_count = dynarray_length(nfa.transitions);
+    index.states_count = n;
+    index.eps_start = calloc(n + 1, sizeof(int));
+    index.edge_start = calloc(n + 1, sizeof(int));
+
+    for(int i = 0;i<transitions_count;i++){
+        if(TRANSITION_IS_EPSILON(nfa.transitions[i])){
+            index.eps_start[nfa.transitions[i].state_from + 1]++;
         }
         else{
-            Fragment nfa_left_fragment = find_split_point(nfa, str, left_fragment, 0, true, debug);
-            Fragment nfa_right_fragment = find_split_point(nfa, str, right_fragment, 0, true, debug);
-
-            switch(min_priority){
-                case ALT_PRIORITY:
-                    //printf("ALTERCATION\n");
-                    int state_head_alt = FA_next_state(nfa);
-                    int state_tail_alt = FA_next_state(nfa);
-
-                    Transition trans_0 = NFA_add_transition(nfa, state_head_alt, nfa_left_fragment.start_index, EPSILON);
-                    Transition trans_1 = NFA_add_transition(nfa, state_head_alt, nfa_right_fragment.start_index, EPSILON);
-                    Transition trans_2 = NFA_add_transition(nfa, nfa_left_fragment.end_index, state_tail_alt, EPSILON);
-                    Transition trans_3 = NFA_add_transition(nfa, nfa_right_fragment.end_index, state_tail_alt, EPSILON);
-
-                    Fragment alt_fragment = {state_head_alt, state_tail_alt};
-
-                    if(final_state > 0){
-                        FA_add_acceptable_state(nfa, state_tail_alt, final_state);
-                    }
-
-                    nfa->initial_state = state_head_alt;
-                    return alt_fragment;
-                    
-                case CONCAT_PRIORITY:
-                    //printf("CONCATENATION\n");
-                    
-                    Transition trans = NFA_add_transition(nfa, nfa_left_fragment.end_index, nfa_right_fragment.start_index, EPSILON);
-                    Fragment concat_fragment = {nfa_left_fragment.start_index, nfa_right_fragment.end_index};
-
-                    if(final_state > 0){
-                        FA_add_acceptable_state(nfa, nfa_right_fragment.end_index, final_state);
-                    }
-
-                    nfa->initial_state = nfa_left_fragment.start_index;
-                    return concat_fragment;
-
-                default:
-                    printf("Something is not right\n");
-            }
+            index.edge_start[nfa.transitions[i].state_from + 1]++;
         }
     }
-}
-
-// Because delta creates a subset from scratch there is no memory leak and no need to make a deep copy
-void e_closure(FA nfa, Subset* states_closure){
-    int* states = SS_to_list_indexes(*states_closure);
-    int* inspect_states = dynarray_create(int);
+    for(int i = 0;i<n;i++){
+        index.eps_start[i+1] += index.eps_start[i];
+        index.edge_start[i+1] += index.edge_start[i];
+    }
 
-    for(int i = 0;i<states_closure->count;i++){
-        dynarray_push(inspect_states, states[i]);
+    index.eps_to = malloc((index.eps_start[n] + 1) * sizeof(int));
+    index.edge_to = malloc((index.edge_start[n] + 1) * sizeof(int));
+    index.edge_char = malloc((index.edge_start[n] + 1) * sizeof(char));
+    index.edge_set = malloc((index.edge_start[n] + 1) * sizeof(int));
+
+    int* eps_fill = malloc(n * sizeof(int));
+    int* edge_fill = malloc(n * sizeof(int));
+    memcpy(eps_fill, index.eps_start, n * sizeof(int));
+    memcpy(edge_fill, index.edge_start, n * sizeof(int));
+    for(int i = 0;i<transitions_count;i++){
+        Transition t = nfa.transitions[i];
+        if(TRANSITION_IS_EPSILON(t)){
+            index.eps_to[eps_fill[t.state_from]++] = t.state_to;
+        }
+        else{
+            index.edge_to[edge_fill[t.state_from]] = t.state_to;
+            index.edge_char[edge_fill[t.state_from]] = t.trans_char;
+            index.edge_set[edge_fill[t.state_from]] = t.byte_set;
+            edge_fill[t.state_from]++;
+        }
     }
+    free(eps_fill);
+    free(edge_fill);
 
-    while(dynarray_length(inspect_states) > 0){
-        int n;
+    // Without epsilon edges there is nothing to close over
+    if(index.eps_start[n] == 0){
+        index.closures = NULL;
+        return index;
+    }
 
-        dynarray_pop(inspect_states, &n);
-        for(int i = 0;i<dynarray_length(nfa.transitions);i++){
-            if(nfa.transitions[i].state_from == n && nfa.transitions[i].trans_char == EPSILON){
-                if(!SS_in(*states_closure, nfa.transitions[i].state_to)){
-                    dynarray_push(inspect_states, nfa.transitions[i].state_to);
-                    SS_add(states_closure, nfa.transitions[i].state_to);
-                }
+    // Closures are computed once per state, reusing one sparse set as worklist
+    index.closures = malloc(n * sizeof(Subset));
+    SparseSet inspect_states = SPS_initialize_empty(n);
+    for(int s = 0;s<n;s++){
+        SPS_clear(&inspect_states);
+        SPS_add(&inspect_states, s);
+        for(int i = 0;i<inspect_states.count;i++){
+            int u = inspect_states.dense[i];
+            for(int j = index.eps_start[u];j<index.eps_start[u+1];j++){
+                SPS_add(&inspect_states, index.eps_to[j]);
             }
         }
+        index.closures[s] = SS_initialize(n, inspect_states.dense, inspect_states.count);
     }
+    SPS_destroy(&inspect_states);
 
-    dynarray_destroy(inspect_states);
-    dynarray_destroy(states);
+    return index;
 }
 
-int* NFA_transition_function(FA nfa, int state, char c){
-    int* out_transitions = dynarray_create(int);
-    for(int i = 0;i<dynarray_length(nfa.transitions);i++){
-        if(nfa.transitions[i].state_from == state && nfa.transitions[i].trans_char == c){
-            dynarray_push(out_transitions, nfa.transitions[i].state_to);
+void NFA_index_destroy(NFAIndex* index){
+    if(index->closures != NULL){
+        for(int i = 0;i<index->states_count;i++){
+            SS_destroy(&index->closures[i]);
         }
+        free(index->closures);
     }
+    free(index->eps_start);
+    free(index->eps_to);
+    free(index->edge_start);
+    free(index->edge_to);
+    free(index->edge_char);
+    free(index->edge_set);
+}
 
-    return out_transitions;
+// Adds the epsilon closure of `state` to `states`. When `state` is already a
+// member its closure is too, so the union is skipped.
+void NFA_index_add_closure(NFAIndex* index, Subset* states, int state){
+    if(SS_in(*states, state)){
+        return;
+    }
+    if(index->closures == NULL){
+        SS_add(states, state);
+        return;
+    }
+    SS_union(*states, index->closures[state]);
 }
 
-int DFA_transition_function(FA dfa, int state, char c){
+// Target of `state` on `c`, -1 if there is none
+int DFA_transition_function(const FA* dfa, int state, char c){
+    if(dfa->table != NULL){
+        int next_state = DFA_table_next(dfa->table, state, c);
+        return next_state == dfa->table->dead_state ? -1 : next_state;
+    }
+
     int out_transition = -1;
-    for(int i = 0;i<dynarray_length(dfa.transitions);i++){
-        if(dfa.transitions[i].state_from == state && dfa.transitions[i].trans_char == c){
-            out_transition = dfa.transitions[i].state_to;
+    for(int i = 0;i<dynarray_length(dfa->transitions);i++){
+        if(dfa->transitions[i].state_from == state && dfa->transitions[i].trans_char == c){
+            out_transition = dfa->transitions[i].state_to;
         }
     }
 
     return out_transition;
 }
 
-Subset delta(FA nfa, Subset q, char c){
-    Subset delta_out = SS_initialize_empty(len_nfa_states(nfa));
-    int* q_list = SS_to_list_indexes(q);
-    for(int i = 0;i<q.count;i++){
-        int* state_transitions = NFA_transition_function(nfa, q_list[i], c);
-        for(int j = 0;j<dynarray_length(state_transitions);j++){
-            SS_add(&delta_out, state_transitions[j]);
-        }
-
-        dynarray_destroy(state_transitions);
+// Table over `next`, states_count + 1 rows of DFA_TABLE_WIDTH targets with
+// the dead row last, which the table takes ownership of
+DFATable* DFA_table_from_rows(int* next, int states_count, AcceptableState* acceptable_states){
+    DFATable* table = malloc(sizeof(DFATable));
+    table->states_count = states_count;
+    table->dead_state = states_count;
+    table->class_count = DFA_TABLE_WIDTH;
+    for(int i = 0;i<DFA_TABLE_WIDTH;i++){
+        table->classes[i] = (unsigned char) i;
     }
+    table->next = next;
 
-    dynarray_destroy(q_list);
+    int rows = states_count + 1;
+    table->accept = malloc(rows * sizeof(int));
+    for(int i = 0;i<rows;i++){
+        table->accept[i] = -1;
+    }
+    for(int i = dynarray_length(acceptable_states) - 1;i>=0;i--){
+        table->accept[acceptable_states[i].state] = acceptable_states[i].category;
+    }
 
-    return delta_out;
+    DFA_table_find_loops(table);
+    return table;
 }
 
-FA NtoDFA(FA nfa){
+// Per row flag telling whether the token a state accepts is dropped from the output
+bool* DFA_table_ignored_states(const DFATable* table, int* ignore_cats, int amount_ignore){
+    int rows = table->states_count + 1;
+    bool* ignored_states = malloc(rows * sizeof(bool));
 
-    int alphabet_length = 0;
-    for(int i = 0;i<256;i++){
-        if(nfa.alphabet[i] == true){
-            alphabet_length++;
+    for(int s = 0;s<rows;s++){
+        ignored_states[s] = false;
+        for(int i = 0;i<amount_ignore && table->accept[s] != -1;i++){
+            if(ignore_cats[i] == table->accept[s]){
+                ignored_states[s] = true;
+                break;
+            }
         }
     }
 
-    char* alphabet_list = char_b_table_to_list(nfa.alphabet);
-
-    Subset q0 = SS_initialize(len_nfa_states(nfa), &nfa.initial_state, 1);
-    e_closure(nfa, &q0);
-    
-    Subset* Q = dynarray_create(Subset);
-    Subset** T = dynarray_create(Subset*);
-    Subset* worklist = dynarray_create(Subset);
+    return ignored_states;
+}
 
-    dynarray_push(Q, q0);
-    dynarray_push(worklist, q0);
+// Records for every live state the byte ranges that keep it where it is
+void DFA_table_find_loops(DFATable* table){
+    table->loops = malloc(table->states_count * sizeof(DFALoop));
 
-    while(dynarray_length(worklist) > 0){
-        Subset q;
-        dynarray_pop(worklist, &q);
+    for(int s = 0;s<table->states_count;s++){
+        DFALoop* loop = &table->loops[s];
+        loop->range_count = 0;
 
-        //SSS_print(q);
+        int b = 0;
+        while(b < DFA_TABLE_WIDTH){
+            if(DFA_table_next(table, s, b) != s){
+                b++;
+                continue;
+            }
 
-        Subset* q_slot = malloc(alphabet_length * sizeof(Subset));
-        dynarray_push(T, q_slot);
+            int low = b;
+            while(b < DFA_TABLE_WIDTH && DFA_table_next(table, s, b) == s){
+                b++;
+            }
 
-        for(int i = 0;i<alphabet_length; i++){
-            char c = alphabet_list[i];
+            if(loop->range_count == DFA_LOOP_MAX_RANGES){
+                loop->range_count = 0;
+                break;
+            }
+            loop->low[loop->range_count] = (unsigned char) low;
+            loop->high[loop->range_count] = (unsigned char) (b - 1);
+            loop->range_count++;
+        }
+    }
+}
 
-            Subset t = delta(nfa, q, c);
-            e_closure(nfa, &t);
+// Returns the first position from `i` whose byte takes `state` anywhere but
+// back to itself, or `end`. Whole blocks are tested against the loop ranges
+// with vector compares, the tail goes through the table.
+size_t DFA_loop_skip(const DFATable* table, int state, char* src, size_t i, size_t end){
+    const DFALoop* loop = &table->loops[state];
+
+#if defined(__AVX2__)
+    __m256i low[DFA_LOOP_MAX_RANGES];
+    __m256i high[DFA_LOOP_MAX_RANGES];
+    for(int r = 0;r<loop->range_count;r++){
+        low[r] = _mm256_set1_epi8((char) loop->low[r]);
+        high[r] = _mm256_set1_epi8((char) loop->high[r]);
+    }
 
-            q_slot[i] = t;
-            //printf("Char %c\n", c);
-            //SSS_print(t);
+    while(i + 32 <= end){
+        __m256i block = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i inside = _mm256_setzero_si256();
+        for(int r = 0;r<loop->range_count;r++){
+            __m256i above = _mm256_cmpeq_epi8(_mm256_max_epu8(block, low[r]), block);
+            __m256i below = _mm256_cmpeq_epi8(_mm256_min_epu8(block, high[r]), block);
+            inside = _mm256_or_si256(inside, _mm256_and_si256(above, below));
+        }
 
-            if(t.count > 0 && !SS_list_in(Q, t)){
-                //printf("Add\n");
-                dynarray_push(Q, t);
-                dynarray_pushleft(worklist, t);
-            }
+        unsigned int outside = ~(unsigned int) _mm256_movemask_epi8(inside);
+        if(outside != 0){
+            return i + __builtin_ctz(outside);
         }
+        i += 32;
+    }
+#elif defined(__SSE2__)
+    __m128i low[DFA_LOOP_MAX_RANGES];
+    __m128i high[DFA_LOOP_MAX_RANGES];
+    for(int r = 0;r<loop->range_count;r++){
+        low[r] = _mm_set1_epi8((char) loop->low[r]);
+        high[r] = _mm_set1_epi8((char) loop->high[r]);
     }
 
-    dynarray_destroy(worklist);
+    while(i + 16 <= end){
+        __m128i block = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i inside = _mm_setzero_si128();
+        for(int r = 0;r<loop->range_count;r++){
+            __m128i above = _mm_cmpeq_epi8(_mm_max_epu8(block, low[r]), block);
+            __m128i below = _mm_cmpeq_epi8(_mm_min_epu8(block, high[r]), block);
+            inside = _mm_or_si128(inside, _mm_and_si128(above, below));
+        }
 
-    FA dfa;
-    FA_initialize(&dfa);
-    
-    for(int i = 0;i<dynarray_length(Q);i++){
-        int next_state = FA_next_state(&dfa);
+        unsigned int outside = ~(unsigned int) _mm_movemask_epi8(inside) & 0xFFFF;
+        if(outside != 0){
+            return i + __builtin_ctz(outside);
+        }
+        i += 16;
     }
+#endif
 
-    for(int i = 0;i<dynarray_length(Q);i++){
-        int max_priority = 0;
-        bool is_accepting_state = false;
+    while(i < end && DFA_table_next(table, state, src[i]) == state){
+        i++;
+    }
+    return i;
+}
 
-        //SSS_print(Q[i]);
-        
-        for(int j = 0;j<dynarray_length(nfa.acceptable_states);j++){
-            if(SS_in(Q[i], nfa.acceptable_states[j].state)){
-                is_accepting_state = true;
-                if(nfa.acceptable_states[j].category > max_priority){
-                    max_priority = nfa.acceptable_states[j].category;
+// Groups bytes whose column is identical in every state into a single class
+// and rebuilds `next` with one column per class. Expects the uncompressed
+// table straight out of DFA_table_from_rows.
+void DFA_table_compress(DFATable* table){
+    assert(table->class_count == DFA_TABLE_WIDTH);
+    int rows = table->states_count + 1;
+    int representatives[DFA_TABLE_WIDTH];
+    int class_count = 0;
+
+    for(int b = 0;b<DFA_TABLE_WIDTH;b++){
+        int found_class = -1;
+        for(int k = 0;k<class_count && found_class == -1;k++){
+            int r = representatives[k];
+            bool same_column = true;
+            for(int s = 0;s<rows;s++){
+                if(table->next[s * DFA_TABLE_WIDTH + b] != table->next[s * DFA_TABLE_WIDTH + r]){
+                    same_column = false;
+                    break;
                 }
             }
+            if(same_column){
+                found_class = k;
+            }
         }
-        if(is_accepting_state == true){
-            FA_add_acceptable_state(&dfa, i, max_priority);
-        }
-    }
-
-    dfa.initial_state = 0;
-    memcpy(dfa.alphabet, nfa.alphabet, sizeof(bool[256]));
-    for(int i = 0;i<dynarray_length(T);i++){
 
-        for(int j = 0;j<alphabet_length;j++){
-            //printf("%d, %c\n", i, alphabet_list[j]);
-            //SSS_print(T[i][j]);
-            int d_index = SS_list_index(Q, T[i][j]);
-            if(d_index != -1){
-                DFA_add_transition(&dfa, i, d_index, alphabet_list[j]);
-            }
+        if(found_class == -1){
+            found_class = class_count;
+            representatives[class_count] = b;
+            class_count++;
         }
+        table->classes[b] = (unsigned char) found_class;
     }
 
-    for(int i = 0;i<dynarray_length(T);i++){
-        for(int j = 0;j<alphabet_length;j++){
-            SS_destroy(&(T[i][j]));
+    int* compressed = malloc(rows * class_count * sizeof(int));
+    for(int s = 0;s<rows;s++){
+        for(int k = 0;k<class_count;k++){
+            compressed[s * class_count + k] = table->next[s * DFA_TABLE_WIDTH + representatives[k]];
         }
-        free(T[i]);
     }
 
-    dynarray_destroy(T);
-    dynarray_destroy(Q);
-
-    return dfa;
+    free(table->next);
+    table->next = compressed;
+    table->class_count = class_count;
 }
 
-Token* scanner_loop_file(FA dfa, char* directory, int* ignore_cats, int amount_ignore){
-    FILE* file_ptr = fopen(directory, "r");
-
-    int current_state = dfa.initial_state;
-    int last_acceptable_state = -1;
-
-    char* curr_word = dynarray_create(char);
-
-    Token* token_list = dynarray_create(Token);
-
-    assert(file_ptr != NULL);
-
-    int c_int;
-    while((c_int = fgetc(file_ptr)) != EOF){
-
-        char c = (char) c_int;
+// Deep copy, shares nothing with `table`
+DFATable* DFA_table_copy(const DFATable* table){
+    DFATable* copy = malloc(sizeof(DFATable));
+    *copy = *table;
+
+    int rows = table->states_count + 1;
+    copy->next = malloc(rows * table->class_count * sizeof(int));
+    memcpy(copy->next, table->next, rows * table->class_count * sizeof(int));
+    copy->accept = malloc(rows * sizeof(int));
+    memcpy(copy->accept, table->accept, rows * sizeof(int));
+    copy->loops = malloc(table->states_count * sizeof(DFALoop));
+    memcpy(copy->loops, table->loops, table->states_count * sizeof(DFALoop));
+    return copy;
+}
 
-        int next_state = DFA_transition_function(dfa, current_state, c);
-    
-        //printf("%c %d\n", c, next_state);
-        
-        if(next_state == -1){
-            if(last_acceptable_state != -1){
-                Token t;
-                char null_token = '\0';
-                dynarray_push(curr_word, null_token);
-                t.word = curr_word;
-                
-                for(int i = 0;i<dynarray_length(dfa.acceptable_states);i++){
-                    if(dfa.acceptable_states[i].state == last_acceptable_state){
-                        t.category = dfa.acceptable_states[i].category;
-                        break;
-                    };
-                }
+void DFA_table_destroy(DFATable* table){
+    free(table->next);
+    free(table->loops);
+    free(table->accept);
+    free(table);
+}
 
-                //printf("%s, %d\n", t.word, t.category);
-                bool is_ignore = false;
-                for(int i=0;i<amount_ignore;i++){
-                    if(ignore_cats[i]==t.category){
-                        is_ignore = true;
-                    }
-                }
+DFAProfile DFA_profile_create(const DFATable* table){
+    DFAProfile profile;
+    profile.states_count = table->states_count;
+    profile.class_count = table->class_count;
+    profile.visits = calloc(table->states_count, sizeof(uint64_t));
+    profile.transitions = calloc((size_t) table->states_count * table->class_count, sizeof(uint64_t));
+    return profile;
+}
 
-                if(!is_ignore){
-                    dynarray_push(token_list, t);
-                }
+void DFA_profile_destroy(DFAProfile* profile){
+    free(profile->visits);
+    free(profile->transitions);
+    profile->visits = NULL;
+    profile->transitions = NULL;
+}
 
-                current_state = DFA_transition_function(dfa, dfa.initial_state, c);
-                last_acceptable_state = -1;
-                if(FA_state_is_acceptable(dfa, current_state)){
-                    last_acceptable_state = current_state;
-                }
-                curr_word = dynarray_create(char);
-                dynarray_push(curr_word, c);
+// Instrumented scan: walks `src` the way scanner_munch_run does, failed
+// marks and loop skips included, and counts every byte it reads through the
+// table in each state and each of its columns. Bytes a loop skip runs over
+// never touch the table and are not counted. Where munch would stop on a
+// lexing error the scan moves on a byte, so a sample with errors still
+// profiles. Counts add up over calls, so a corpus can be profiled one file
+// at a time.
+void DFA_profile_scan(const FA* dfa, DFAProfile* profile, char* src, size_t length){
+    const DFATable* table = dfa->table;
+    assert(profile->states_count == table->states_count && profile->class_count == table->class_count);
+    ScanMarks failed;
+    failed.bits = NULL;
+    failed.positions = NULL;
+    failed.capacity = 0;
+    failed.row_words = (table->states_count + 1 + 63) / 64;
+    int* trail = dynarray_create(int);
+
+    size_t word_start = 0;
+    while(word_start < length){
+        int state = dfa->initial_state;
+        int acceptable_state = -1;
+        size_t word_end = word_start;
+        _dynarray_field_set(trail, LENGTH, 0);
+
+        size_t i = word_start;
+        while(i < length){
+            int column = table->classes[(unsigned char) src[i]];
+            int next_state = table->next[state * table->class_count + column];
+            profile->visits[state]++;
+            profile->transitions[(size_t) state * table->class_count + column]++;
+            if(next_state == table->dead_state){
+                break;
             }
-            else{
-                printf("\nLexer Compilation Error\n");
+            if(failed.capacity != 0 && scanner_marks_test(&failed, i + 1, next_state)){
                 break;
             }
-        }
-        else{
-            dynarray_push(curr_word, c);
-            current_state = next_state;
-            if(FA_state_is_acceptable(dfa, current_state)){
-                last_acceptable_state = current_state;
+
+            state = next_state;
+            i++;
+            if(table->accept[state] == -1){
+                dynarray_push(trail, state);
+                continue;
+            }
+
+            acceptable_state = state;
+            _dynarray_field_set(trail, LENGTH, 0);
+            if(table->loops[state].range_count > 0){
+                i = DFA_loop_skip(table, state, src, i, length);
             }
+            word_end = i;
         }
-         
-    }
 
-    if(last_acceptable_state != -1){
-        Token t;
-        char null_token = '\0';
-        dynarray_push(curr_word, null_token);
-        t.word = curr_word;
-        
-        for(int i = 0;i<dynarray_length(dfa.acceptable_states);i++){
-            if(dfa.acceptable_states[i].state == last_acceptable_state){
-                t.category = dfa.acceptable_states[i].category;
-                break;
-            };
+        if(acceptable_state == -1){
+            word_start++;
+            continue;
         }
 
-        bool is_ignore = false;
-        for(int i=0;i<amount_ignore;i++){
-            if(ignore_cats[i]==t.category){
-                is_ignore = true;
+        for(int k = 0;k<dynarray_length(trail);k++){
+            if(!scanner_marks_set(&failed, word_end, word_end + 1 + k, trail[k])){
+                break;
             }
         }
+        word_start = word_end;
+    }
 
-        if(!is_ignore){
-            dynarray_push(token_list, t);
-        }
+    scanner_marks_destroy(&failed);
+    dynarray_destroy(trail);
+}
 
-        Token final_token;
-        final_token.word = "";
-        final_token.category = 0;
+void DFA_profile_file(const FA* dfa, DFAProfile* profile, char* directory){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
 
-        dynarray_push(token_list, final_token);
+    DFA_profile_scan(dfa, profile, source.data, source.length);
+    source_close(&source);
+}
+
+// Renumbering that lays states out in hot chains: the most visited state
+// not yet placed goes next, followed by its most taken successor, and that
+// successor's, for as long as one is left unplaced. A state and the one a
+// scan usually moves to from it end up in neighbouring rows. Ties keep the
+// old order. new_number[s] is where state s goes.
+int* DFA_profile_order(DFAProfile profile, const DFATable* table){
+    assert(profile.states_count == table->states_count && profile.class_count == table->class_count);
+    int* by_visits = malloc(profile.states_count * sizeof(int));
+    for(int s = 0;s<profile.states_count;s++){
+        by_visits[s] = s;
     }
-    else{
-        printf("\nLexer Compilation Error\n");
+
+    // Insertion sort, stable and the tables are small
+    for(int i = 1;i<profile.states_count;i++){
+        int s = by_visits[i];
+        int j = i - 1;
+        while(j >= 0 && profile.visits[by_visits[j]] < profile.visits[s]){
+            by_visits[j + 1] = by_visits[j];
+            j--;
+        }
+        by_visits[j + 1] = s;
     }
 
-    return token_list;
+    int* new_number = malloc(profile.states_count * sizeof(int));
+    for(int s = 0;s<profile.states_count;s++){
+        new_number[s] = -1;
+    }
+
+    int placed = 0;
+    for(int i = 0;i<profile.states_count;i++){
+        int s = by_visits[i];
+        while(s != -1 && new_number[s] == -1){
+            new_number[s] = placed++;
+
+            // Columns sharing a target add up, the hottest edge picks the
+            // successor
+            int successor = -1;
+            uint64_t successor_weight = 0;
+            for(int k = 0;k<profile.class_count;k++){
+                int target = table->next[s * table->class_count + k];
+                if(target == table->dead_state || new_number[target] != -1){
+                    continue;
+                }
+                uint64_t weight = 0;
+                for(int l = 0;l<profile.class_count;l++){
+                    if(table->next[s * table->class_count + l] == target){
+                        weight += profile.transitions[(size_t) s * profile.class_count + l];
+                    }
+                }
+                if(weight > successor_weight){
+                    successor = target;
+                    successor_weight = weight;
+                }
+            }
+            s = successor;
+        }
+    }
+
+    free(by_visits);
+    return new_number;
 }
 
-Token* scanner_loop_string(FA dfa, char* src, int* ignore_cats, int amount_ignore){
-    int current_state = dfa.initial_state;
-    int last_acceptable_state = -1;
+// Moves every row to new_number[s], the dead row stays last
+void DFA_table_renumber(DFATable* table, const int* new_number){
+    int rows = table->states_count + 1;
+    int* next = malloc(rows * table->class_count * sizeof(int));
+    int* accept = malloc(rows * sizeof(int));
+    DFALoop* loops = malloc(table->states_count * sizeof(DFALoop));
+
+    for(int s = 0;s<rows;s++){
+        int row = s == table->dead_state ? s : new_number[s];
+        for(int k = 0;k<table->class_count;k++){
+            int target = table->next[s * table->class_count + k];
+            next[row * table->class_count + k] = target == table->dead_state ? target : new_number[target];
+        }
+        accept[row] = table->accept[s];
+        if(s != table->dead_state){
+            loops[row] = table->loops[s];
+        }
+    }
 
-    char* curr_word = dynarray_create(char);
+    free(table->next);
+    free(table->accept);
+    free(table->loops);
+    table->next = next;
+    table->accept = accept;
+    table->loops = loops;
+}
 
-    Token* token_list = dynarray_create(Token);
+// Renumbers the states of `dfa`, transitions, accepts and table alike, so
+// that state s becomes new_number[s]. With DFA_profile_order this packs the
+// hottest rows together at the front of the table.
+void DFA_renumber(FA* dfa, const int* new_number){
+    for(int i = 0;i<dynarray_length(dfa->transitions);i++){
+        dfa->transitions[i].state_from = new_number[dfa->transitions[i].state_from];
+        dfa->transitions[i].state_to = new_number[dfa->transitions[i].state_to];
+    }
+    for(int i = 0;i<dynarray_length(dfa->acceptable_states);i++){
+        dfa->acceptable_states[i].state = new_number[dfa->acceptable_states[i].state];
+    }
+    dfa->initial_state = new_number[dfa->initial_state];
 
-    if(src == NULL){
-        return 0;
+    if(dfa->table != NULL){
+        DFA_table_renumber(dfa->table, new_number);
+    }
+}
+
+FA NtoDFA(FA nfa){
+
+    int alphabet_length = 0;
+    for(int i = 0;i<256;i++){
+        if(nfa.alphabet[i] == true){
+            alphabet_length++;
+        }
+    }
+
+    char* alphabet_list = char_b_table_to_list(nfa.alphabet);
+
+    NFAIndex index = NFA_index_create(nfa);
+
+    int alphabet_position[256];
+    for(int i = 0;i<256;i++){
+        alphabet_position[i] = -1;
+    }
+    for(int i = 0;i<alphabet_length;i++){
+        alphabet_position[(unsigned char) alphabet_list[i]] = i;
     }
 
-    int src_i = 0;
-    while(src[src_i] != '\0'){
-        char c = src[src_i];
+    // Targets of the labelled edges leaving the current subset, bucketed by char
+    int** char_targets = malloc(alphabet_length * sizeof(int*));
+    for(int i = 0;i<alphabet_length;i++){
+        char_targets[i] = dynarray_create(int);
+    }
 
-        int next_state = DFA_transition_function(dfa, current_state, c);
+    Subset q0 = SS_initialize_empty(len_nfa_states(nfa));
+    NFA_index_add_closure(&index, &q0, nfa.initial_state);
+    Subset t = SS_initialize_empty(len_nfa_states(nfa));
     
-        //printf("%c %d\n", c, next_state);
-        
-        if(next_state == -1){
-            if(last_acceptable_state != -1){
-                Token t;
-                char null_token = '\0';
-                dynarray_push(curr_word, null_token);
-                t.word = curr_word;
-                
-                for(int i = 0;i<dynarray_length(dfa.acceptable_states);i++){
-                    if(dfa.acceptable_states[i].state == last_acceptable_state){
-                        t.category = dfa.acceptable_states[i].category;
-                        break;
-                    };
+    Subset* Q = dynarray_create(Subset);
+    SubsetSet Q_set = SSS_create(SSS_DEFAULT_BUCKETS);
+    int** T = dynarray_create(int*);
+
+    SSS_add(&Q_set, q0);
+    dynarray_push(Q, q0);
+
+    // Q doubles as the worklist: subsets are appended as they are found and
+    // taken in that order, so Q[q_index .. ) are the ones still unexpanded
+    for(int q_index = 0;q_index<dynarray_length(Q);q_index++){
+        assert(q_index == dynarray_length(T));
+        Subset q = Q[q_index];
+
+        // Successor state index for every alphabet char, -1 for the empty subset
+        int* q_slot = malloc(alphabet_length * sizeof(int));
+        dynarray_push(T, q_slot);
+
+        for(int i = 0;i<alphabet_length;i++){
+            _dynarray_field_set(char_targets[i], LENGTH, 0);
+        }
+        for(int s = SS_next(q, 0);s != -1;s = SS_next(q, s+1)){
+            for(int j = index.edge_start[s];j<index.edge_start[s+1];j++){
+                if(index.edge_set[j] == -1){
+                    int position = alphabet_position[(unsigned char) index.edge_char[j]];
+                    dynarray_push(char_targets[position], index.edge_to[j]);
+                    continue;
                 }
 
-                //printf("%s, %d\n", t.word, t.category);
-                
-                bool is_ignore = false;
-                for(int i=0;i<amount_ignore;i++){
-                    if(ignore_cats[i]==t.category){
-                        is_ignore = true;
+                ByteSet set = nfa.byte_sets[index.edge_set[j]];
+                for(int w = 0;w<4;w++){
+                    uint64_t word = set.bits[w];
+                    while(word != 0){
+                        int position = alphabet_position[w * 64 + __builtin_ctzll(word)];
+                        dynarray_push(char_targets[position], index.edge_to[j]);
+                        word &= word - 1;
                     }
                 }
+            }
+        }
 
-                if(!is_ignore){
-                    dynarray_push(token_list, t);
-                }
+        for(int i = 0;i<alphabet_length; i++){
+            if(dynarray_length(char_targets[i]) == 0){
+                q_slot[i] = -1;
+                continue;
+            }
+
+            SS_clear(&t);
+            for(int j = 0;j<dynarray_length(char_targets[i]);j++){
+                NFA_index_add_closure(&index, &t, char_targets[i][j]);
+            }
+
+            int t_index = SSS_index(&Q_set, t);
+            if(t_index == -1){
+                Subset new_state = SS_deep_copy(t);
+                t_index = SSS_add(&Q_set, new_state);
+                dynarray_push(Q, new_state);
+            }
+            q_slot[i] = t_index;
+        }
+    }
+
+    for(int i = 0;i<alphabet_length;i++){
+        dynarray_destroy(char_targets[i]);
+    }
+    free(char_targets);
+    SS_destroy(&t);
+    NFA_index_destroy(&index);
+
+    SSS_destroy(&Q_set);
+
+    DFABuilder builder;
+    DFA_builder_init(&builder);
+    for(int i = 0;i<dynarray_length(Q);i++){
+        DFA_builder_add_state(&builder);
+    }
+
+    // Highest category each NFA state accepts, -1 if it doesn't
+    int* nfa_category = malloc(len_nfa_states(nfa) * sizeof(int));
+    for(int s = 0;s<len_nfa_states(nfa);s++){
+        nfa_category[s] = -1;
+    }
+    for(int j = 0;j<dynarray_length(nfa.acceptable_states);j++){
+        AcceptableState acc_state = nfa.acceptable_states[j];
+        if(acc_state.category > nfa_category[acc_state.state]){
+            nfa_category[acc_state.state] = acc_state.category;
+        }
+    }
+
+    for(int i = 0;i<dynarray_length(Q);i++){
+        int max_priority = -1;
+        for(int s = SS_next(Q[i], 0);s != -1;s = SS_next(Q[i], s+1)){
+            if(nfa_category[s] > max_priority){
+                max_priority = nfa_category[s];
+            }
+        }
+        if(max_priority != -1){
+            DFA_builder_add_acceptable_state(&builder, i, max_priority);
+        }
+    }
+    free(nfa_category);
+
+    memcpy(builder.dfa.alphabet, nfa.alphabet, sizeof(bool[256]));
+    for(int i = 0;i<dynarray_length(T);i++){
+        for(int j = 0;j<alphabet_length;j++){
+            if(T[i][j] != -1){
+                DFA_builder_add_transition(&builder, i, T[i][j], alphabet_list[j]);
+            }
+        }
+        free(T[i]);
+    }
+
+    for(int i = 0;i<dynarray_length(Q);i++){
+        SS_destroy(&Q[i]);
+    }
+
+    dynarray_destroy(T);
+    dynarray_destroy(Q);
+    dynarray_destroy(alphabet_list);
+
+    return DFA_builder_finish(&builder, 0);
+}
+
+// Hopcroft's partition refinement over the compiled table. States start out
+// split by accept category (the dead row counts as non accepting) and blocks
+// are refined against (block, byte class) splitters until stable, always
+// queueing the smaller half of a split, for O(n*k*log n) overall. Every
+// state equivalent to the dead row is dropped from the result.
+FA DFA_minimize(FA dfa){
+    DFATable* table = dfa.table;
+    int n = table->states_count + 1;
+    int k = table->class_count;
+
+    int* category = malloc(n * sizeof(int));
+    for(int i = 0;i<n;i++){
+        category[i] = -1;
+    }
+    for(int i = 0;i<dynarray_length(dfa.acceptable_states);i++){
+        category[dfa.acceptable_states[i].state] = dfa.acceptable_states[i].category;
+    }
+
+    // Inverse transitions, grouped by (byte class, target state)
+    int* inv_start = calloc(k * n + 1, sizeof(int));
+    int* inv_states = malloc(k * n * sizeof(int));
+    for(int s = 0;s<n;s++){
+        for(int c = 0;c<k;c++){
+            inv_start[c * n + table->next[s * k + c] + 1]++;
+        }
+    }
+    for(int i = 0;i<k * n;i++){
+        inv_start[i+1] += inv_start[i];
+    }
+    int* inv_fill = malloc(k * n * sizeof(int));
+    memcpy(inv_fill, inv_start, k * n * sizeof(int));
+    for(int s = 0;s<n;s++){
+        for(int c = 0;c<k;c++){
+            inv_states[inv_fill[c * n + table->next[s * k + c]]++] = s;
+        }
+    }
+    free(inv_fill);
+
+    // Partition: block b owns elems[block_first[b] .. block_end[b])
+    int* elems = malloc(n * sizeof(int));
+    int* location = malloc(n * sizeof(int));
+    int* block_of = malloc(n * sizeof(int));
+    int* block_first = malloc(n * sizeof(int));
+    int* block_end = malloc(n * sizeof(int));
+    int* block_marked = calloc(n, sizeof(int));
+    int block_count = 0;
+
+    int* block_category = malloc(n * sizeof(int));
+    int* block_size = calloc(n, sizeof(int));
+    for(int s = 0;s<n;s++){
+        int b = 0;
+        while(b < block_count && block_category[b] != category[s]){
+            b++;
+        }
+        if(b == block_count){
+            block_category[block_count] = category[s];
+            block_count++;
+        }
+        block_of[s] = b;
+        block_size[b]++;
+    }
 
-                current_state = DFA_transition_function(dfa, dfa.initial_state, c);
-                last_acceptable_state = -1;
-                if(FA_state_is_acceptable(dfa, current_state)){
-                    last_acceptable_state = current_state;
+    int offset = 0;
+    for(int b = 0;b<block_count;b++){
+        block_first[b] = offset;
+        block_end[b] = offset;
+        offset += block_size[b];
+    }
+    for(int s = 0;s<n;s++){
+        int b = block_of[s];
+        location[s] = block_end[b];
+        elems[block_end[b]++] = s;
+    }
+    free(block_size);
+    free(block_category);
+
+    bool* in_worklist = calloc(n * k, sizeof(bool));
+    int* worklist = dynarray_create(int);
+    for(int b = 0;b<block_count;b++){
+        for(int c = 0;c<k;c++){
+            int splitter = b * k + c;
+            in_worklist[splitter] = true;
+            dynarray_push(worklist, splitter);
+        }
+    }
+
+    int* predecessors = dynarray_create(int);
+    int* touched = dynarray_create(int);
+
+    while(dynarray_length(worklist) > 0){
+        int splitter;
+        dynarray_pop(worklist, &splitter);
+        in_worklist[splitter] = false;
+        int splitter_block = splitter / k;
+        int c = splitter % k;
+
+        _dynarray_field_set(predecessors, LENGTH, 0);
+        for(int i = block_first[splitter_block];i<block_end[splitter_block];i++){
+            int t = elems[i];
+            for(int j = inv_start[c * n + t];j<inv_start[c * n + t + 1];j++){
+                dynarray_push(predecessors, inv_states[j]);
+            }
+        }
+
+        // Move every predecessor to the marked front of its block
+        _dynarray_field_set(touched, LENGTH, 0);
+        for(int i = 0;i<dynarray_length(predecessors);i++){
+            int s = predecessors[i];
+            int b = block_of[s];
+            if(block_marked[b] == 0){
+                dynarray_push(touched, b);
+            }
+
+            int swap_location = block_first[b] + block_marked[b];
+            int swap_state = elems[swap_location];
+            elems[swap_location] = s;
+            elems[location[s]] = swap_state;
+            location[swap_state] = location[s];
+            location[s] = swap_location;
+            block_marked[b]++;
+        }
+
+        for(int i = 0;i<dynarray_length(touched);i++){
+            int b = touched[i];
+            int marked = block_marked[b];
+            block_marked[b] = 0;
+            if(marked == block_end[b] - block_first[b]){
+                continue;
+            }
+
+            int new_block = block_count;
+            block_count++;
+            block_first[new_block] = block_first[b];
+            block_end[new_block] = block_first[b] + marked;
+            block_first[b] = block_end[new_block];
+            for(int j = block_first[new_block];j<block_end[new_block];j++){
+                block_of[elems[j]] = new_block;
+            }
+
+            bool new_smaller = marked <= block_end[b] - block_first[b];
+            for(int d = 0;d<k;d++){
+                int queued = -1;
+                if(in_worklist[b * k + d] || new_smaller){
+                    queued = new_block * k + d;
+                }
+                else{
+                    queued = b * k + d;
+                }
+                if(!in_worklist[queued]){
+                    in_worklist[queued] = true;
+                    dynarray_push(worklist, queued);
                 }
-                curr_word = dynarray_create(char);
-                dynarray_push(curr_word, c);
+            }
+        }
+    }
+
+    dynarray_destroy(touched);
+    dynarray_destroy(predecessors);
+    dynarray_destroy(worklist);
+    free(in_worklist);
+    free(inv_start);
+    free(inv_states);
+
+    // Renumber blocks, initial state first, the dead block is left out
+    int dead_block = block_of[table->dead_state];
+    int* block_state = malloc(block_count * sizeof(int));
+    int* block_rep = malloc(block_count * sizeof(int));
+    for(int b = 0;b<block_count;b++){
+        block_state[b] = -1;
+    }
+
+    DFABuilder builder;
+    DFA_builder_init(&builder);
+
+    int initial_block = block_of[dfa.initial_state];
+    if(initial_block != dead_block){
+        block_state[initial_block] = DFA_builder_add_state(&builder);
+        block_rep[initial_block] = dfa.initial_state;
+    }
+    for(int s = 0;s<table->states_count;s++){
+        int b = block_of[s];
+        if(b != dead_block && block_state[b] == -1){
+            block_state[b] = DFA_builder_add_state(&builder);
+            block_rep[b] = s;
+        }
+    }
+
+    char* alphabet_list = char_b_table_to_list(dfa.alphabet);
+    for(int b = 0;b<block_count;b++){
+        if(block_state[b] == -1){
+            continue;
+        }
+        int rep = block_rep[b];
+        if(category[rep] != -1){
+            DFA_builder_add_acceptable_state(&builder, block_state[b], category[rep]);
+        }
+        for(int i = 0;i<dynarray_length(alphabet_list);i++){
+            int to_block = block_of[DFA_table_next(table, rep, alphabet_list[i])];
+            if(to_block != dead_block){
+                DFA_builder_add_transition(&builder, block_state[b], block_state[to_block], alphabet_list[i]);
+            }
+        }
+    }
+
+    memcpy(builder.dfa.alphabet, dfa.alphabet, sizeof(bool[256]));
+    FA min_dfa = DFA_builder_finish(&builder, 0);
+
+    dynarray_destroy(alphabet_list);
+    free(block_state);
+    free(block_rep);
+    free(elems);
+    free(location);
+    free(block_of);
+    free(block_first);
+    free(block_end);
+    free(block_marked);
+    free(category);
+
+    return min_dfa;
+}
+
+void scanner_emit_span(const FA* dfa, TokenStream* stream, char* src, size_t word_start, size_t word_length, int acceptable_state, const bool* ignored_states){
+    if(ignored_states[acceptable_state]){
+        return;
+    }
+
+    TokenSpan span;
+    span.category = dfa->table->accept[acceptable_state];
+    span.length = (int) word_length;
+    if(stream->pool != NULL){
+        span.offset = dynarray_length(stream->pool);
+        dynarray_extend(stream->pool, src + word_start, word_length);
+    }
+    else{
+        span.offset = word_start;
+    }
+    dynarray_push(stream->spans, span);
+}
+
+// Restarts the scan at `i`, the byte the previous token could not take
+void scanner_restart(const FA* dfa, ScanState* state, char* src, size_t i){
+    state->current_state = DFA_table_next(dfa->table, dfa->initial_state, src[i]);
+    state->last_acceptable_state = -1;
+    if(dfa->table->accept[state->current_state] != -1){
+        state->last_acceptable_state = state->current_state;
+    }
+    state->word_start = i;
+}
+
+// Scans src[from .. to) starting from `state`, pushing every token that ends
+// inside the range. The token still open at `to` is left in `state`. Returns
+// false when a byte can't continue or start any token.
+bool scanner_spans_range(const FA* dfa, TokenStream* stream, char* src, size_t from, size_t to, ScanState* state, const bool* ignored_states){
+    const DFATable* table = dfa->table;
+
+    for(size_t i = from;i<to;i++){
+        char c = src[i];
+
+        int next_state = DFA_table_next(table, state->current_state, c);
+        
+        if(next_state == table->dead_state){
+            if(state->last_acceptable_state != -1){
+                scanner_emit_span(dfa, stream, src, state->word_start, i - state->word_start, state->last_acceptable_state, ignored_states);
+                scanner_restart(dfa, state, src, i);
             }
             else{
-                printf("\nLexer Compilation Error\n");
-                break;
+                return false;
             }
         }
         else{
-            dynarray_push(curr_word, c);
-            current_state = next_state;
-            if(FA_state_is_acceptable(dfa, current_state)){
-                last_acceptable_state = current_state;
+            state->current_state = next_state;
+            if(table->accept[next_state] != -1){
+                state->last_acceptable_state = state->current_state;
+            }
+            if(table->loops[next_state].range_count > 0){
+                i = DFA_loop_skip(table, next_state, src, i + 1, to) - 1;
             }
         }
-        
-        src_i++;
     }
 
-    if(last_acceptable_state != -1){
-        Token t;
-        char null_token = '\0';
-        dynarray_push(curr_word, null_token);
-        t.word = curr_word;
-        
-        for(int i = 0;i<dynarray_length(dfa.acceptable_states);i++){
-            if(dfa.acceptable_states[i].state == last_acceptable_state){
-                t.category = dfa.acceptable_states[i].category;
+    return true;
+}
+
+// Closes the token left open at the end of the input and appends the end token
+void scanner_spans_finish(const FA* dfa, TokenStream* stream, char* src, size_t length, ScanState state, const bool* ignored_states){
+    if(state.last_acceptable_state != -1){
+        scanner_emit_span(dfa, stream, src, state.word_start, length - state.word_start, state.last_acceptable_state, ignored_states);
+
+        TokenSpan final_span;
+        final_span.offset = 0;
+        final_span.length = 0;
+        final_span.category = 0;
+
+        dynarray_push(stream->spans, final_span);
+    }
+    else{
+        scanner_report_error();
+    }
+}
+
+// Scans `length` bytes straight out of `src` into spans over `src`. With
+// `copy_words` every word is also appended to a string pool owned by the
+// stream, so `src` can be released once this returns.
+TokenStream scanner_spans_buffer(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore, bool copy_words){
+    bool* ignored_states = DFA_table_ignored_states(dfa.table, ignore_cats, amount_ignore);
+    TokenStream stream = scanner_spans_run(&dfa, src, length, ignored_states, copy_words);
+    free(ignored_states);
+
+    return stream;
+}
+
+// scanner_spans_buffer once the ignored rows are known. Only reads `dfa`
+// and `ignored_states`, so any number of threads can run it on the same ones.
+TokenStream scanner_spans_run(const FA* dfa, char* src, size_t length, const bool* ignored_states, bool copy_words){
+    ScanState state;
+    state.current_state = dfa->initial_state;
+    state.last_acceptable_state = -1;
+    state.word_start = 0;
+
+    TokenStream stream;
+    stream.spans = dynarray_create(TokenSpan);
+    stream.pool = copy_words ? dynarray_create(char) : NULL;
+    stream.owns_source = false;
+
+    if(!scanner_spans_range(dfa, &stream, src, 0, length, &state, ignored_states)){
+        scanner_report_error();
+    }
+    scanner_spans_finish(dfa, &stream, src, length, state, ignored_states);
+
+    stream.text = copy_words ? stream.pool : src;
+    return stream;
+}
+
+// Every scanner reports a token it can't match through here. Tests that
+// feed malformed input on purpose clear scanner_report_errors.
+bool scanner_report_errors = true;
+
+void scanner_report_error(){
+    if(scanner_report_errors){
+        printf("\nLexer Compilation Error\n");
+    }
+}
+
+// Points at the first malformed UTF-8 byte of a source file, which no
+// codepoint range in the regex can match. Lexing goes on regardless. This is
+// a pass of its own before the scan, on one thread even ahead of a parallel
+// scan: the ASCII skip in utf8_validate speeds it up but not the scan loop.
+void scanner_check_utf8(Source source, char* directory){
+    size_t valid = utf8_validate(source.data, source.length);
+    if(valid != source.length){
+        printf("\nInvalid UTF-8 in %s at byte %zu\n", directory, valid);
+    }
+}
+
+// The spans point into the mapped file, which stays open until the stream is destroyed
+TokenStream scanner_spans_file(FA dfa, char* directory, int* ignore_cats, int amount_ignore){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
+    scanner_check_utf8(source, directory);
+
+    TokenStream stream = scanner_spans_buffer(dfa, source.data, source.length, ignore_cats, amount_ignore, false);
+    stream.source = source;
+    stream.owns_source = true;
+    return stream;
+}
+
+// Longest match scan: every token is the longest prefix of the rest of the
+// input that some rule accepts, and the next token starts right after it.
+// The DFA runs on until it dies, remembering the state and end of the last
+// accept, then the scan rewinds to that end. Bytes read past it are read
+// again by the next token, which alone could make the scan quadratic, so
+// every (state, position) pair passed after the last accept is marked as
+// failed (Reps' memoization): no accept is reachable from it, and a later
+// token that reaches it stops right there. Each pair is passed at most once
+// after its token's last accept, which keeps the scan linear. Marks are only
+// read at or past the start of the current token, so they are kept in a
+// ScanMarks window that slides with it, see scanner_marks_set.
+TokenStream scanner_spans_munch(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore){
+    bool* ignored_states = DFA_table_ignored_states(dfa.table, ignore_cats, amount_ignore);
+    TokenStream stream = scanner_munch_run(&dfa, src, length, ignored_states);
+    free(ignored_states);
+
+    return stream;
+}
+
+bool scanner_marks_test(const ScanMarks* marks, size_t position, int state){
+    size_t slot = position & (marks->capacity - 1);
+    return marks->positions[slot] == position && (marks->bits[slot * marks->row_words + state / 64] >> (state % 64)) & 1;
+}
+
+// Makes room for positions up to `low` + `span` - 1, keeping the rows of
+// positions from `low` on. False if the memory isn't there, `marks` is then
+// left as it was.
+bool scanner_marks_grow(ScanMarks* marks, size_t low, size_t span){
+    size_t capacity = marks->capacity == 0 ? SCANNER_MARKS_MIN : marks->capacity;
+    while(capacity < span){
+        capacity *= 2;
+    }
+
+    uint64_t* bits = calloc(capacity * marks->row_words, sizeof(uint64_t));
+    size_t* positions = malloc(capacity * sizeof(size_t));
+    if(bits == NULL || positions == NULL){
+        free(bits);
+        free(positions);
+        return false;
+    }
+    for(size_t slot = 0;slot<capacity;slot++){
+        positions[slot] = SIZE_MAX;
+    }
+
+    for(size_t slot = 0;slot<marks->capacity;slot++){
+        size_t position = marks->positions[slot];
+        if(position == SIZE_MAX || position < low){
+            continue;
+        }
+        size_t new_slot = position & (capacity - 1);
+        positions[new_slot] = position;
+        memcpy(bits + new_slot * marks->row_words, marks->bits + slot * marks->row_words, marks->row_words * sizeof(uint64_t));
+    }
+
+    free(marks->bits);
+    free(marks->positions);
+    marks->bits = bits;
+    marks->positions = positions;
+    marks->capacity = capacity;
+    return true;
+}
+
+// Marks `state` at `position` as failed. No mark below `low` is read again,
+// so the window only has to span [low, position] and a slot whose position
+// fell below `low` is simply reused. Returns false, without marking, when
+// the window can't grow: the scan is then still right, only slower.
+bool scanner_marks_set(ScanMarks* marks, size_t low, size_t position, int state){
+    if(position - low >= marks->capacity && !scanner_marks_grow(marks, low, position - low + 1)){
+        return false;
+    }
+
+    size_t slot = position & (marks->capacity - 1);
+    uint64_t* row = marks->bits + slot * marks->row_words;
+    if(marks->positions[slot] != position){
+        memset(row, 0, marks->row_words * sizeof(uint64_t));
+        marks->positions[slot] = position;
+    }
+    row[state / 64] |= (uint64_t) 1 << (state % 64);
+    return true;
+}
+
+void scanner_marks_destroy(ScanMarks* marks){
+    free(marks->bits);
+    free(marks->positions);
+    marks->bits = NULL;
+    marks->positions = NULL;
+    marks->capacity = 0;
+}
+
+// scanner_spans_munch once the ignored rows are known, reentrant like scanner_spans_run
+TokenStream scanner_munch_run(const FA* dfa, char* src, size_t length, const bool* ignored_states){
+    const DFATable* table = dfa->table;
+    ScanMarks failed;
+    failed.bits = NULL;
+    failed.positions = NULL;
+    failed.capacity = 0;
+    failed.row_words = (table->states_count + 1 + 63) / 64;
+    int* trail = dynarray_create(int);
+
+    TokenStream stream;
+    stream.spans = dynarray_create(TokenSpan);
+    stream.pool = NULL;
+    stream.owns_source = false;
+
+    bool lexed = true;
+    size_t word_start = 0;
+    while(word_start < length){
+        int state = dfa->initial_state;
+        int acceptable_state = -1;
+        size_t word_end = word_start;
+        _dynarray_field_set(trail, LENGTH, 0);
+
+        size_t i = word_start;
+        while(i < length){
+            int next_state = DFA_table_next(table, state, src[i]);
+            if(next_state == table->dead_state){
+                break;
+            }
+            if(failed.capacity != 0 && scanner_marks_test(&failed, i + 1, next_state)){
+                break;
+            }
+
+            state = next_state;
+            i++;
+            if(table->accept[state] == -1){
+                dynarray_push(trail, state);
+                continue;
+            }
+
+            acceptable_state = state;
+            _dynarray_field_set(trail, LENGTH, 0);
+            if(table->loops[state].range_count > 0){
+                i = DFA_loop_skip(table, state, src, i, length);
+            }
+            word_end = i;
+        }
+
+        if(acceptable_state == -1){
+            scanner_report_error();
+            lexed = false;
+            break;
+        }
+
+        // trail[k] is the state reached at word_end + 1 + k, the next token
+        // starts at word_end so nothing before it is read again
+        for(int k = 0;k<dynarray_length(trail);k++){
+            if(!scanner_marks_set(&failed, word_end, word_end + 1 + k, trail[k])){
+                break;
+            }
+        }
+
+        scanner_emit_span(dfa, &stream, src, word_start, word_end - word_start, acceptable_state, ignored_states);
+        word_start = word_end;
+    }
+
+    if(lexed){
+        TokenSpan final_span;
+        final_span.offset = 0;
+        final_span.length = 0;
+        final_span.category = 0;
+
+        dynarray_push(stream.spans, final_span);
+    }
+
+    scanner_marks_destroy(&failed);
+    dynarray_destroy(trail);
+
+    stream.text = src;
+    return stream;
+}
+
+TokenStream scanner_spans_file_munch(FA dfa, char* directory, int* ignore_cats, int amount_ignore){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
+    scanner_check_utf8(source, directory);
+
+    TokenStream stream = scanner_spans_munch(dfa, source.data, source.length, ignore_cats, amount_ignore);
+    stream.source = source;
+    stream.owns_source = true;
+    return stream;
+}
+
+TokenStream scanner_spans_string(FA dfa, char* src, int* ignore_cats, int amount_ignore, bool copy_words){
+    assert(src != NULL);
+    return scanner_spans_buffer(dfa, src, strlen(src), ignore_cats, amount_ignore, copy_words);
+}
+
+// Runs every candidate entry state through the chunk in lockstep until it
+// dies. Runs that reach the same state on the same byte have the same future,
+// so they are joined under a new node and stepped once; a node only keeps the
+// last accepting state seen since it was created, the latest one on the path
+// from a leaf to its root is what the entry state passed last.
+void scanner_chunk_sync(ScanChunk* chunk){
+    const FA* dfa = chunk->dfa;
+    const DFATable* table = dfa->table;
+    int width = table->states_count + 1;
+    int max_nodes = 2 * width;
+
+    int* parent = malloc(sizeof(int) * max_nodes);
+    int* accepted = malloc(sizeof(int) * max_nodes);
+    int* node_state = malloc(sizeof(int) * max_nodes);
+    size_t* death = malloc(sizeof(size_t) * max_nodes);
+    size_t* merged_at = malloc(sizeof(size_t) * max_nodes);
+    int* leaf = malloc(sizeof(int) * width);
+    int* holder = malloc(sizeof(int) * width);
+    size_t* seen_at = malloc(sizeof(size_t) * width);
+    int* active = malloc(sizeof(int) * width);
+    int* next_active = malloc(sizeof(int) * width);
+
+    int node_count = 0;
+    int active_count = 0;
+    for(int s = 0;s<width;s++){
+        seen_at[s] = SIZE_MAX;
+        leaf[s] = -1;
+        if(!chunk->all_states && s != dfa->initial_state){
+            continue;
+        }
+
+        int node = node_count++;
+        parent[node] = -1;
+        accepted[node] = -1;
+        node_state[node] = s;
+        death[node] = SIZE_MAX;
+        merged_at[node] = SIZE_MAX;
+        leaf[s] = node;
+        active[active_count++] = node;
+    }
+
+    for(size_t i = chunk->start;i<chunk->end && active_count > 0;i++){
+        char c = chunk->src[i];
+        int next_count = 0;
+
+        for(int a = 0;a<active_count;a++){
+            int node = active[a];
+            int next_state = DFA_table_next(table, node_state[node], c);
+
+            if(next_state == table->dead_state){
+                death[node] = i;
+                continue;
+            }
+            if(table->accept[next_state] != -1){
+                accepted[node] = next_state;
+            }
+            node_state[node] = next_state;
+
+            if(seen_at[next_state] == i){
+                int other = next_active[holder[next_state]];
+                if(merged_at[other] != i){
+                    int merged = node_count++;
+                    parent[merged] = -1;
+                    accepted[merged] = -1;
+                    node_state[merged] = next_state;
+                    death[merged] = SIZE_MAX;
+                    merged_at[merged] = i;
+
+                    parent[other] = merged;
+                    next_active[holder[next_state]] = merged;
+                    other = merged;
+                }
+                parent[node] = other;
+            }
+            else{
+                seen_at[next_state] = i;
+                holder[next_state] = next_count;
+                next_active[next_count++] = node;
+            }
+        }
+
+        int* swap = active;
+        active = next_active;
+        next_active = swap;
+        active_count = next_count;
+    }
+
+    chunk->runs = dynarray_create(ScanRun);
+    for(int s = 0;s<width;s++){
+        chunk->entry_run[s] = -1;
+        chunk->entry_accept[s] = -1;
+        chunk->entry_state[s] = -1;
+        if(leaf[s] == -1){
+            continue;
+        }
+
+        int node = leaf[s];
+        while(true){
+            if(accepted[node] != -1){
+                chunk->entry_accept[s] = accepted[node];
+            }
+            if(parent[node] == -1){
+                break;
+            }
+            node = parent[node];
+        }
+
+        if(death[node] == SIZE_MAX){
+            chunk->entry_state[s] = node_state[node];
+            continue;
+        }
+
+        for(int r = 0;r<dynarray_length(chunk->runs);r++){
+            if(chunk->runs[r].sync == death[node]){
+                chunk->entry_run[s] = r;
                 break;
-            };
+            }
+        }
+        if(chunk->entry_run[s] == -1){
+            ScanRun run;
+            run.sync = death[node];
+            chunk->entry_run[s] = dynarray_length(chunk->runs);
+            dynarray_push(chunk->runs, run);
+        }
+    }
+
+    free(parent);
+    free(accepted);
+    free(node_state);
+    free(death);
+    free(merged_at);
+    free(leaf);
+    free(holder);
+    free(seen_at);
+    free(active);
+    free(next_active);
+}
+
+// Lexes a chunk from every position its entry states can resynchronize at
+void* scanner_chunk_lex(void* arg){
+    ScanChunk* chunk = arg;
+    scanner_chunk_sync(chunk);
+
+    for(int r = 0;r<dynarray_length(chunk->runs);r++){
+        ScanRun* run = &chunk->runs[r];
+
+        TokenStream stream;
+        stream.spans = dynarray_create(TokenSpan);
+        stream.pool = NULL;
+
+        scanner_restart(chunk->dfa, &run->state, chunk->src, run->sync);
+        run->failed = !scanner_spans_range(chunk->dfa, &stream, chunk->src, run->sync + 1, chunk->end, &run->state, chunk->ignored_states);
+        run->spans = stream.spans;
+    }
+
+    return NULL;
+}
+
+// Same stream as scanner_spans_buffer without a pool. The input is cut in
+// `thread_count` chunks that are lexed at once from every state they could
+// be entered in, then stitched in order following the state each chunk
+// actually leaves the next one in.
+TokenStream scanner_spans_parallel(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore, int thread_count){
+    if(thread_count < 2 || length / thread_count < SCANNER_PARALLEL_MIN_CHUNK){
+        return scanner_spans_buffer(dfa, src, length, ignore_cats, amount_ignore, false);
+    }
+
+    int width = dfa.table->states_count + 1;
+    bool* ignored_states = DFA_table_ignored_states(dfa.table, ignore_cats, amount_ignore);
+    ScanChunk* chunks = malloc(sizeof(ScanChunk) * thread_count);
+    for(int k = 0;k<thread_count;k++){
+        chunks[k].dfa = &dfa;
+        chunks[k].src = src;
+        chunks[k].start = length / thread_count * k;
+        chunks[k].end = k == thread_count - 1 ? length : length / thread_count * (k + 1);
+        chunks[k].all_states = k != 0;
+        chunks[k].ignored_states = ignored_states;
+        chunks[k].entry_run = malloc(sizeof(int) * width);
+        chunks[k].entry_accept = malloc(sizeof(int) * width);
+        chunks[k].entry_state = malloc(sizeof(int) * width);
+    }
+
+#ifndef _WIN32
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    for(int k = 1;k<thread_count;k++){
+        pthread_create(&threads[k], NULL, scanner_chunk_lex, &chunks[k]);
+    }
+    scanner_chunk_lex(&chunks[0]);
+    for(int k = 1;k<thread_count;k++){
+        pthread_join(threads[k], NULL);
+    }
+    free(threads);
+#else
+    for(int k = 0;k<thread_count;k++){
+        scanner_chunk_lex(&chunks[k]);
+    }
+#endif
+
+    TokenStream stream;
+    stream.spans = dynarray_create(TokenSpan);
+    stream.pool = NULL;
+    stream.owns_source = false;
+
+    ScanState state;
+    state.current_state = dfa.initial_state;
+    state.last_acceptable_state = -1;
+    state.word_start = 0;
+
+    bool failed = false;
+    for(int k = 0;k<thread_count && !failed;k++){
+        ScanChunk* chunk = &chunks[k];
+        int entry = state.current_state;
+
+        int accepted = state.last_acceptable_state;
+        if(chunk->entry_accept[entry] != -1){
+            accepted = chunk->entry_accept[entry];
+        }
+
+        if(chunk->entry_run[entry] == -1){
+            state.current_state = chunk->entry_state[entry];
+            state.last_acceptable_state = accepted;
+            continue;
         }
 
-        //printf("\n%s, %d\n", t.word, t.category);
-        bool is_ignore = false;
+        if(accepted == -1){
+            state.last_acceptable_state = -1;
+            failed = true;
+            break;
+        }
+
+        ScanRun* run = &chunk->runs[chunk->entry_run[entry]];
+        scanner_emit_span(&dfa, &stream, src, state.word_start, run->sync - state.word_start, accepted, ignored_states);
+        dynarray_extend(stream.spans, run->spans, dynarray_length(run->spans));
+        state = run->state;
+        failed = run->failed;
+    }
+
+    if(failed){
+        scanner_report_error();
+    }
+    scanner_spans_finish(&dfa, &stream, src, length, state, ignored_states);
+
+    for(int k = 0;k<thread_count;k++){
+        for(int r = 0;r<dynarray_length(chunks[k].runs);r++){
+            dynarray_destroy(chunks[k].runs[r].spans);
+        }
+        dynarray_destroy(chunks[k].runs);
+        free(chunks[k].entry_run);
+        free(chunks[k].entry_accept);
+        free(chunks[k].entry_state);
+    }
+    free(chunks);
+    free(ignored_states);
+
+    stream.text = src;
+    return stream;
+}
+
+TokenStream scanner_spans_file_parallel(FA dfa, char* directory, int* ignore_cats, int amount_ignore, int thread_count){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
+    scanner_check_utf8(source, directory);
+
+    TokenStream stream = scanner_spans_parallel(dfa, source.data, source.length, ignore_cats, amount_ignore, thread_count);
+    stream.source = source;
+    stream.owns_source = true;
+    return stream;
+}
+
+// Same stream as scanner_spans_munch from a lexer compiled by DFA_export_c,
+// every token is one call to `match`
+TokenStream scanner_spans_direct(DirectMatch match, char* src, size_t length, int* ignore_cats, int amount_ignore){
+    TokenStream stream;
+    stream.spans = dynarray_create(TokenSpan);
+    stream.pool = NULL;
+    stream.owns_source = false;
+
+    bool lexed = true;
+    size_t word_start = 0;
+    while(word_start < length){
+        size_t word_end;
+        int category = match(src, length, word_start, &word_end);
+
+        if(category == -1){
+            scanner_report_error();
+            lexed = false;
+            break;
+        }
+
+        bool ignored = false;
         for(int i=0;i<amount_ignore;i++){
-            if(ignore_cats[i]==t.category){
-                is_ignore = true;
+            if(ignore_cats[i]==category){
+                ignored = true;
+                break;
             }
         }
 
-        if(!is_ignore){
-            dynarray_push(token_list, t);
+        if(!ignored){
+            TokenSpan span;
+            span.offset = word_start;
+            span.length = (int) (word_end - word_start);
+            span.category = category;
+            dynarray_push(stream.spans, span);
         }
+        word_start = word_end;
+    }
 
-        Token final_token;
-        final_token.word = "";
-        final_token.category = 0;
+    if(lexed){
+        TokenSpan final_span;
+        final_span.offset = 0;
+        final_span.length = 0;
+        final_span.category = 0;
 
-        dynarray_push(token_list, final_token);
+        dynarray_push(stream.spans, final_span);
     }
-    else{
-        printf("\nLexer Compilation Error\n");
+
+    stream.text = src;
+    return stream;
+}
+
+TokenStream scanner_spans_file_direct(DirectMatch match, char* directory, int* ignore_cats, int amount_ignore){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
+    scanner_check_utf8(source, directory);
+
+    TokenStream stream = scanner_spans_direct(match, source.data, source.length, ignore_cats, amount_ignore);
+    stream.source = source;
+    stream.owns_source = true;
+    return stream;
+}
+
+char* token_stream_word(TokenStream stream, int i){
+    return stream.text + stream.spans[i].offset;
+}
+
+void token_stream_destroy(TokenStream* stream){
+    dynarray_destroy(stream->spans);
+    if(stream->pool != NULL){
+        dynarray_destroy(stream->pool);
+    }
+    if(stream->owns_source){
+        source_close(&stream->source);
+    }
+}
+
+// Copies every word of the stream into its own string
+Token* token_stream_to_tokens(TokenStream stream){
+    Token* token_list = dynarray_create_prealloc(Token, dynarray_length(stream.spans));
+
+    for(int i = 0;i<dynarray_length(stream.spans);i++){
+        Token t;
+        t.category = stream.spans[i].category;
+        if(stream.spans[i].length == 0){
+            t.word = "";
+        }
+        else{
+            t.word = malloc(stream.spans[i].length + 1);
+            memcpy(t.word, token_stream_word(stream, i), stream.spans[i].length);
+            t.word[stream.spans[i].length] = '\0';
+        }
+        dynarray_push(token_list, t);
+    }
+
+    return token_list;
+}
+
+// Same scan as scanner_spans_buffer, with every word copied into its own string
+Token* scanner_loop_buffer(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore){
+    TokenStream stream = scanner_spans_buffer(dfa, src, length, ignore_cats, amount_ignore, false);
+    Token* token_list = token_stream_to_tokens(stream);
+
+    token_stream_destroy(&stream);
+    return token_list;
+}
+
+Token* scanner_loop_file(FA dfa, char* directory, int* ignore_cats, int amount_ignore){
+    Source source;
+    bool opened = source_open(&source, directory);
+    assert(opened);
+
+    Token* token_list = scanner_loop_buffer(dfa, source.data, source.length, ignore_cats, amount_ignore);
+
+    source_close(&source);
+    return token_list;
+}
+
+Token* scanner_loop_string(FA dfa, char* src, int* ignore_cats, int amount_ignore){
+    if(src == NULL){
+        return 0;
     }
 
+    return scanner_loop_buffer(dfa, src, strlen(src), ignore_cats, amount_ignore);
+}
+
+Token* scanner_loop_file_parallel(FA dfa, char* directory, int* ignore_cats, int amount_ignore, int thread_count){
+    TokenStream stream = scanner_spans_file_parallel(dfa, directory, ignore_cats, amount_ignore, thread_count);
+    Token* token_list = token_stream_to_tokens(stream);
+
+    token_stream_destroy(&stream);
     return token_list;
 }
 
-FA MakeFA(char *src, char* out_dir, bool debug){
+Scanner* scanner_open(FA dfa, char* directory, int* ignore_cats, int amount_ignore){
+    FILE* file_ptr = fopen(directory, "rb");
+    if(file_ptr == NULL){
+        return NULL;
+    }
+
+    Scanner* scanner = malloc(sizeof(Scanner));
+    scanner->dfa = dfa;
+    scanner->file = file_ptr;
+    scanner->capacity = SCANNER_WINDOW;
+    scanner->window = malloc(scanner->capacity);
+    scanner->begin = 0;
+    scanner->pos = 0;
+    scanner->end = 0;
+    scanner->current_state = dfa.initial_state;
+    scanner->last_acceptable_state = -1;
+    scanner->status = SCANNER_RUNNING;
+    scanner->ignored_states = DFA_table_ignored_states(dfa.table, ignore_cats, amount_ignore);
+    scanner->word = dynarray_create(char);
+
+    return scanner;
+}
+
+// Slides the pending token to the front of the window and reads after it.
+// The window only grows when a single token doesn't fit in it.
+bool scanner_fill(Scanner* scanner){
+    if(scanner->begin > 0){
+        memmove(scanner->window, scanner->window + scanner->begin, scanner->end - scanner->begin);
+        scanner->pos -= scanner->begin;
+        scanner->end -= scanner->begin;
+        scanner->begin = 0;
+    }
+
+    if(scanner->end == scanner->capacity){
+        scanner->capacity *= 2;
+        scanner->window = realloc(scanner->window, scanner->capacity);
+    }
+
+    size_t read_amount = fread(scanner->window + scanner->end, 1, scanner->capacity - scanner->end, scanner->file);
+    scanner->end += read_amount;
+    return read_amount > 0;
+}
+
+// Ends the pending token at `word_end`. Returns false when its category is ignored.
+bool scanner_take_token(Scanner* scanner, size_t word_end, int acceptable_state, Token* out){
+    size_t word_start = scanner->begin;
+    scanner->begin = word_end;
+
+    if(scanner->ignored_states[acceptable_state]){
+        return false;
+    }
+
+    char null_char = '\0';
+    _dynarray_field_set(scanner->word, LENGTH, 0);
+    dynarray_extend(scanner->word, scanner->window + word_start, word_end - word_start);
+    dynarray_push(scanner->word, null_char);
+
+    out->word = scanner->word;
+    out->category = scanner->dfa.table->accept[acceptable_state];
+    return true;
+}
+
+// Produces the same tokens as scanner_loop_file, ending with the category 0
+// end token. `out->word` is owned by the scanner and only valid until the
+// next call. Returns false once the input is exhausted or fails to lex.
+bool scanner_next_token(Scanner* scanner, Token* out){
+    DFATable* table = scanner->dfa.table;
+
+    while(scanner->status == SCANNER_RUNNING){
+        if(scanner->pos == scanner->end && !scanner_fill(scanner)){
+            if(scanner->last_acceptable_state == -1){
+                scanner_report_error();
+                scanner->status = SCANNER_DONE;
+                return false;
+            }
+
+            scanner->status = SCANNER_AT_END;
+            if(scanner_take_token(scanner, scanner->end, scanner->last_acceptable_state, out)){
+                return true;
+            }
+            break;
+        }
+
+        char c = scanner->window[scanner->pos];
+        int next_state = DFA_table_next(table, scanner->current_state, c);
+
+        if(next_state == table->dead_state){
+            int accepted_state = scanner->last_acceptable_state;
+            if(accepted_state == -1){
+                scanner_report_error();
+                scanner->status = SCANNER_DONE;
+                return false;
+            }
+
+            scanner->current_state = DFA_table_next(table, scanner->dfa.initial_state, c);
+            scanner->last_acceptable_state = -1;
+            if(table->accept[scanner->current_state] != -1){
+                scanner->last_acceptable_state = scanner->current_state;
+            }
+
+            bool taken = scanner_take_token(scanner, scanner->pos, accepted_state, out);
+            scanner->pos++;
+            if(taken){
+                return true;
+            }
+        }
+        else{
+            scanner->current_state = next_state;
+            if(table->accept[scanner->current_state] != -1){
+                scanner->last_acceptable_state = scanner->current_state;
+            }
+            scanner->pos++;
+            if(table->loops[next_state].range_count > 0){
+                scanner->pos = DFA_loop_skip(table, next_state, scanner->window, scanner->pos, scanner->end);
+            }
+        }
+    }
+
+    if(scanner->status == SCANNER_AT_END){
+        scanner->status = SCANNER_DONE;
+        out->word = "";
+        out->category = 0;
+        return true;
+    }
+
+    return false;
+}
+
+void scanner_close(Scanner* scanner){
+    fclose(scanner->file);
+    free(scanner->window);
+    free(scanner->ignored_states);
+    dynarray_destroy(scanner->word);
+    free(scanner);
+}
+
+// Text dump MakeFA leaves in `out_dir`, `nfa` is NULL on a cache hit
+void MakeFA_export(char* out_dir, char* src, FA* nfa, FA dfa){
+    FILE* out = fopen(out_dir, "w");
+    if(out == NULL){
+        return;
+    }
+
+    fprintf(out, "--- Post Regex ---\n");
+    fprintf(out, "%s\n", src);
+    fprintf(out, "\nNFA -> \n");
+    if(nfa != NULL){
+        FA_export(*nfa, out);
+    }
+    else{
+        fprintf(out, "not built, DFA loaded from %s\n", DFA_CACHE_DIR);
+    }
+    fprintf(out, "\nDFA -> \n");
+    FA_export(dfa, out);
+    fclose(out);
+}
+
+// `construction` picks the NFA the DFA is determinized from: Thompson's, or
+// the epsilon free position automaton whose subsets need no closures.
+FA MakeFA(char *src, char* out_dir, bool minimize, enum FAConstruction construction, bool debug){
     if(debug){
         printf("\ninitializing non finite automata...\n");
     }
     FA nfa;
     FA_initialize(&nfa);
-    if(debug){
-        printf("\npreprocessign regex...\n\n");
+    FA cached_dfa;
+    if(DFA_cache_load(src, minimize, construction, &cached_dfa)){
+        if(debug){
+            printf("\nDFA loaded from cache -> %d states, %d byte classes\n", cached_dfa.table->states_count, cached_dfa.table->class_count);
+        }
+        MakeFA_export(out_dir, src, NULL, cached_dfa);
+        FA_destroy(&nfa);
+        return cached_dfa;
     }
-    char* regex = regex_prep(src);
-    Fragment fragment_start = {0, strlen(regex)};
+
+    RegexToken* postfix = regex_to_postfix(src);
 
     if(debug){
-        printf("Processsed Regex -> \n");
-        printf("%s\n", regex);
-        printf("\ncreating thomson's construction...\n\n");
+        printf("Regex -> \n");
+        printf("%s\n", src);
+        printf("\nPostfix Regex -> \n");
+        regex_postfix_print(postfix);
+        printf(construction == FA_GLUSHKOV ? "\ncreating glushkov's construction...\n\n" : "\ncreating thomson's construction...\n\n");
     }
 
-    find_split_point(&nfa, regex, fragment_start, false, true, debug);
+    if(construction == FA_GLUSHKOV){
+        NFA_glushkov_from_postfix(&nfa, postfix);
+    }
+    else{
+        NFA_from_postfix(&nfa, postfix);
+    }
+    dynarray_destroy(postfix);
 
     if(debug){
         printf("\nNFA -> \n");
@@ -849,23 +2401,28 @@ FA MakeFA(char *src, char* out_dir, bool debug){
     }
     FA dfa = NtoDFA(nfa);
 
+    if(minimize){
+        if(debug){
+            printf("\nminimizing definite finite automata...\n\n");
+        }
+        FA min_dfa = DFA_minimize(dfa);
+        FA_destroy(&dfa);
+        dfa = min_dfa;
+    }
+
     if(debug){
         printf("DFA -> \n");
         FA_print(dfa);
+        printf("\nDFA table -> %d states, %d byte classes\n", dfa.table->states_count, dfa.table->class_count);
     }
 
-    FILE* out = fopen(out_dir, "w");
+    MakeFA_export(out_dir, src, &nfa, dfa);
 
-    fprintf(out, "--- Post Regex ---\n");
-    fprintf(out, "%s\n", regex);
-    fprintf(out, "\nNFA -> \n");
-    FA_export(nfa, out);
-    fprintf(out, "\nDFA -> \n");
-    FA_export(dfa, out);
-    fclose(out);
+    if(!DFA_cache_store(dfa, src, minimize, construction) && debug){
+        printf("\ncould not write DFA cache to %s\n", DFA_CACHE_DIR);
+    }
 
     FA_destroy(&nfa);
-    dynarray_destroy(regex);
 
     return dfa;
 }
\ No newline at end of file
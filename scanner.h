@@ -1,90 +1,334 @@
+#ifndef SCANNER
+#define SCANNER
+
 #include <stdlib.h>
 #include <string.h> 
 #include <stdio.h>
+#include <stdint.h>
 
 #include "subset.h"
+#include "source.h"
+#include "re_pp.h"
 
 
-#define ALT_PRIORITY 0
-#define CONCAT_PRIORITY 1
-#define CLOS_PRIORITY 2
-#define FIN_PRIORITY 3
-#define MAX_PRIORITY 4
-
 #define EPSILON '@'
 
+#define DFA_TABLE_WIDTH 256
+#define DFA_table_next(table, state, c) ((table)->next[(state) * (table)->class_count + (table)->classes[(unsigned char) (c)]])
+
 #define len_nfa_states(fa) dynarray_length(fa.states)
+#define TRANSITION_IS_EPSILON(t) ((t).byte_set == -1 && (t).trans_char == EPSILON)
 
 typedef struct AcceptableState{
     int state;
     int category;
 }  AcceptableState;
 
+// `byte_set` indexes FA.byte_sets for an NFA edge taken on any byte of a
+// bracket expression, it is -1 for a single `trans_char` edge.
 typedef struct Transition{
     int state_from;
     int state_to;
     char trans_char;
+    int byte_set;
 } Transition;
 
+#define DFA_LOOP_MAX_RANGES 4
+
+// Bytes a state loops back to itself on, as at most DFA_LOOP_MAX_RANGES
+// inclusive ranges. range_count is 0 when the state has no such loop or its
+// set is too scattered to test with a few compares.
+typedef struct DFALoop{
+    int range_count;
+    unsigned char low[DFA_LOOP_MAX_RANGES];
+    unsigned char high[DFA_LOOP_MAX_RANGES];
+} DFALoop;
+
+// Dense state x byte class transition table compiled from a DFA. Row
+// `dead_state` is an extra sink row, every missing transition points there.
+// Bytes that behave the same in every state share a column in `next`.
+// accept[s] is the category state s accepts, -1 if it doesn't.
+typedef struct DFATable{
+    int* next;
+    int states_count;
+    int dead_state;
+    int class_count;
+    unsigned char classes[DFA_TABLE_WIDTH];
+    DFALoop* loops;
+    int* accept;
+} DFATable;
+
+// Counts gathered by DFA_profile_scan over a sample corpus: visits[s] is
+// how many bytes were read in state s, transitions[s * class_count + k]
+// how many of those were of byte class k.
+typedef struct DFAProfile{
+    int states_count;
+    int class_count;
+    uint64_t* visits;
+    uint64_t* transitions;
+} DFAProfile;
+
 typedef struct FA{
     int* states;
     int initial_state;
     bool alphabet[256];
     Transition* transitions;
     AcceptableState* acceptable_states;
+    ByteSet* byte_sets;
+    DFATable* table;
 } FA;
 
+// DFA under construction. rows[s * DFA_TABLE_WIDTH + c] is the target of
+// state s on byte c, -1 while there is none, so adding a transition and
+// checking it isn't a duplicate are both O(1).
+typedef struct DFABuilder{
+    FA dfa;
+    int* rows;
+} DFABuilder;
+
+// CSR adjacency of an NFA: the epsilon and labelled edges leaving state s are
+// eps_to[eps_start[s] .. eps_start[s+1]) and edge_*[edge_start[s] .. edge_start[s+1]).
+// edge_set[e] is the byte set edge e is labelled with, or -1 when it is
+// labelled with edge_char[e]. closures[s] is the epsilon closure of s, the
+// array is NULL when the NFA has no epsilon edges and every closure is {s}.
+typedef struct NFAIndex{
+    int states_count;
+    int* eps_start;
+    int* eps_to;
+    int* edge_start;
+    int* edge_to;
+    char* edge_char;
+    int* edge_set;
+    Subset* closures;
+} NFAIndex;
+
 typedef struct Token{
     char* word;
     int category;
 } Token;
 
+// Token as a slice of the text it was scanned from, no copy of the word
+typedef struct TokenSpan{
+    size_t offset;
+    int length;
+    int category;
+} TokenSpan;
+
+// Span tokens plus the text their offsets index into. `text` is either the
+// scanned buffer itself, the mapped `source` for files, or `pool` when the
+// caller asked for the words to be copied because the input isn't stable.
+typedef struct TokenStream{
+    char* text;
+    TokenSpan* spans;
+    char* pool;
+    Source source;
+    bool owns_source;
+} TokenStream;
+
+// Where a scan stands between two calls: the state reached, the last
+// accepting state since `word_start`, and where the open token began.
+typedef struct ScanState{
+    int current_state;
+    int last_acceptable_state;
+    size_t word_start;
+} ScanState;
+
+// Matcher generated by DFA_export_c: scans the longest token from `start`,
+// sets *end past it and returns its category, or -1 if nothing was accepted.
+typedef int (*DirectMatch)(const char* src, size_t length, size_t start, size_t* end);
+
+#ifndef SCANNER_PARALLEL_MIN_CHUNK
+#define SCANNER_PARALLEL_MIN_CHUNK 65536
+#endif
+
+// Scan of a chunk resumed at `sync`, a position where some entry state dies
+// and the scanner restarts from the initial state. `state` is where it stands
+// at the end of the chunk, `failed` if it hit a byte no token accepts.
+typedef struct ScanRun{
+    size_t sync;
+    TokenSpan* spans;
+    ScanState state;
+    bool failed;
+} ScanRun;
+
+// Slice of the input lexed on its own thread, before the state it is entered
+// in is known. For every candidate entry state s: entry_run[s] is the run it
+// resynchronizes into, or -1 if the token it is in spans the whole chunk, in
+// which case it leaves in entry_state[s]. entry_accept[s] is the last
+// accepting state passed before that, -1 if none.
+typedef struct ScanChunk{
+    const FA* dfa;
+    char* src;
+    size_t start;
+    size_t end;
+    bool all_states;
+    bool* ignored_states;
+    int* entry_run;
+    int* entry_accept;
+    int* entry_state;
+    ScanRun* runs;
+} ScanChunk;
+
+#ifndef SCANNER_WINDOW
+#define SCANNER_WINDOW 65536
+#endif
+
+enum ScannerStatus{
+    SCANNER_RUNNING,
+    SCANNER_AT_END,
+    SCANNER_DONE
+};
+
+// Pull scanner over a file. Only window[begin .. end) is kept in memory: the
+// token being matched plus whatever was read ahead. The DFA state survives
+// refills, so a token split across two reads is matched as one.
+typedef struct Scanner{
+    FA dfa;
+    FILE* file;
+    char* window;
+    size_t capacity;
+    size_t begin;
+    size_t pos;
+    size_t end;
+    int current_state;
+    int last_acceptable_state;
+    enum ScannerStatus status;
+    bool* ignored_states;
+    char* word;
+} Scanner;
+
+#ifndef SCANNER_MARKS_MIN
+#define SCANNER_MARKS_MIN 64
+#endif
+
+// Failed (position, state) pairs of the longest match scan, for a window of
+// positions: slot p % capacity holds the marks of position positions[slot]
+// (SIZE_MAX when unused) as row_words words of one bit per state. capacity
+// is a power of two, 0 until the first mark.
+typedef struct ScanMarks{
+    uint64_t* bits;
+    size_t* positions;
+    size_t capacity;
+    int row_words;
+} ScanMarks;
+
 typedef struct Fragment{
     int start_index;
     int end_index;
 } Fragment;
 
+// Sub-expression of a position automaton: whether it matches the empty word,
+// the positions (NFA states) it can start and end on, and the categories of
+// the tags reached from its start without reading a byte.
+typedef struct GlushkovFragment{
+    bool nullable;
+    int* first;
+    int* last;
+    int* tags;
+} GlushkovFragment;
+
+// How MakeFA turns the regex into an NFA before subset construction
+enum FAConstruction{
+    FA_THOMPSON,
+    FA_GLUSHKOV
+};
+
 void print_transition(Transition t);
 void FA_print(FA fa);
 void print_token_seq(Token* tokens);
 
 void export_transition(Transition t, FILE* out);
+void export_set_transition(Transition t, ByteSet set, FILE* out);
 void FA_export(FA fa, FILE* out);
 void export_token_seq(Token* tokens, FILE* out);
+void print_token_stream(TokenStream stream);
+void export_token_stream(TokenStream stream, FILE* out);
 
 void states_print(int* states);
 
 int FA_initialize(FA *fa);
 void FA_destroy(FA *fa);
 int FA_next_state(FA *fa);
-bool int_dynarray_in(int* arr, int search);
-bool FA_valid_state(FA fa, int state_check);
 bool FA_fast_valid_state(FA fa, int state_check);
 void FA_add_acceptable_state(FA *fa, int acceptable_state, int category);
-bool FA_state_is_acceptable(FA fa, int state);
+bool FA_state_is_acceptable(const FA* fa, int state);
 int acceptable_states_mapping(char* c);
 
 Transition NFA_add_transition(FA *nfa, int _from, int _to, char _trans_char);
-Transition DFA_add_transition(FA *dfa, int _from, int _to, char _trans_char);
+int FA_add_byte_set(FA *fa, ByteSet set);
+Transition NFA_add_set_transition(FA *nfa, int _from, int _to, ByteSet set);
+Transition NFA_add_labelled_transition(FA *nfa, int _from, int _to, Transition label);
 
-int altercation(Fragment *left_fragment, Fragment *right_fragment, int *priority, int depth, int i);
-int concatenation(Fragment fragment, Fragment *left_fragment, Fragment *right_fragment, int *priority, int depth, int i, char next_char, char prev_char);
-int closure(Fragment fragment, Fragment *left_fragment, Fragment *right_fragment, int *priority, bool *final_split, int depth, bool split_found, int pass_priority, int i);
-int fin_type(Fragment fragment, Fragment *left_fragment, Fragment *right_fragment, int *priority, bool *final_split, char* state_identifier, char next_char, int depth, int i);
-int parenthesis(Fragment fragment, Fragment *left_fragment, bool *final_split, bool split_found, int i);
+void DFA_builder_init(DFABuilder* builder);
+int DFA_builder_add_state(DFABuilder* builder);
+void DFA_builder_add_transition(DFABuilder* builder, int _from, int _to, char _trans_char);
+void DFA_builder_add_acceptable_state(DFABuilder* builder, int acceptable_state, int category);
+FA DFA_builder_finish(DFABuilder* builder, int initial_state);
 
 void print_safe_char(char c);
-Fragment find_split_point(FA* nfa, char* str, Fragment fragment, int final_state, bool recursion, bool debug);
+void regex_postfix_print(RegexToken* postfix);
+Fragment NFA_from_postfix(FA* nfa, RegexToken* postfix);
+void glushkov_fragment_destroy(GlushkovFragment* fragment);
+void NFA_glushkov_from_postfix(FA* nfa, RegexToken* postfix);
+
+
+NFAIndex NFA_index_create(FA nfa);
+void NFA_index_destroy(NFAIndex* index);
+void NFA_index_add_closure(NFAIndex* index, Subset* states, int state);
 
-void e_closure(FA nfa, Subset* states_closure);
-Subset delta(FA nfa, Subset q, char c);
+int DFA_transition_function(const FA* dfa, int state, char c);
 
-int* NFA_transition_function(FA nfa, int state, char c);
-int DFA_transition_function(FA dfa, int state, char c);
+DFATable* DFA_table_from_rows(int* next, int states_count, AcceptableState* acceptable_states);
+void DFA_table_compress(DFATable* table);
+void DFA_table_find_loops(DFATable* table);
+bool* DFA_table_ignored_states(const DFATable* table, int* ignore_cats, int amount_ignore);
+size_t DFA_loop_skip(const DFATable* table, int state, char* src, size_t i, size_t end);
+DFATable* DFA_table_copy(const DFATable* table);
+void DFA_table_destroy(DFATable* table);
+
+DFAProfile DFA_profile_create(const DFATable* table);
+void DFA_profile_destroy(DFAProfile* profile);
+void DFA_profile_scan(const FA* dfa, DFAProfile* profile, char* src, size_t length);
+void DFA_profile_file(const FA* dfa, DFAProfile* profile, char* directory);
+int* DFA_profile_order(DFAProfile profile, const DFATable* table);
+void DFA_table_renumber(DFATable* table, const int* new_number);
+void DFA_renumber(FA* dfa, const int* new_number);
 
 FA NtoDFA(FA nfa);
+FA DFA_minimize(FA dfa);
+TokenStream scanner_spans_buffer(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore, bool copy_words);
+TokenStream scanner_spans_file(FA dfa, char* directory, int* ignore_cats, int amount_ignore);
+TokenStream scanner_spans_run(const FA* dfa, char* src, size_t length, const bool* ignored_states, bool copy_words);
+TokenStream scanner_spans_string(FA dfa, char* src, int* ignore_cats, int amount_ignore, bool copy_words);
+TokenStream scanner_spans_munch(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore);
+bool scanner_marks_test(const ScanMarks* marks, size_t position, int state);
+bool scanner_marks_grow(ScanMarks* marks, size_t low, size_t span);
+bool scanner_marks_set(ScanMarks* marks, size_t low, size_t position, int state);
+void scanner_marks_destroy(ScanMarks* marks);
+TokenStream scanner_munch_run(const FA* dfa, char* src, size_t length, const bool* ignored_states);
+TokenStream scanner_spans_file_munch(FA dfa, char* directory, int* ignore_cats, int amount_ignore);
+TokenStream scanner_spans_parallel(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore, int thread_count);
+TokenStream scanner_spans_file_parallel(FA dfa, char* directory, int* ignore_cats, int amount_ignore, int thread_count);
+TokenStream scanner_spans_direct(DirectMatch match, char* src, size_t length, int* ignore_cats, int amount_ignore);
+TokenStream scanner_spans_file_direct(DirectMatch match, char* directory, int* ignore_cats, int amount_ignore);
+// Cleared to keep scanners from printing the tokens they fail to match
+extern bool scanner_report_errors;
+void scanner_report_error();
+void scanner_check_utf8(Source source, char* directory);
+char* token_stream_word(TokenStream stream, int i);
+void token_stream_destroy(TokenStream* stream);
+Token* token_stream_to_tokens(TokenStream stream);
+
+Scanner* scanner_open(FA dfa, char* directory, int* ignore_cats, int amount_ignore);
+bool scanner_next_token(Scanner* scanner, Token* out);
+void scanner_close(Scanner* scanner);
+
+Token* scanner_loop_buffer(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore);
 Token* scanner_loop_file(FA dfa, char* directory, int* ignore_cats, int amount_ignore);
 Token* scanner_loop_string(FA dfa, char* src, int* ignore_cats, int amount_ignore);
+Token* scanner_loop_file_parallel(FA dfa, char* directory, int* ignore_cats, int amount_ignore, int thread_count);
 
-FA MakeFA(char *src, char* out_dir, bool debug);
+void MakeFA_export(char* out_dir, char* src, FA* nfa, FA dfa);
+FA MakeFA(char *src, char* out_dir, bool minimize, enum FAConstruction construction, bool debug);
 
+#endif // SCANNER
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "source.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+// No mmap here, the file is read with stdio in large blocks instead
+bool source_open(Source* source, char* directory){
+    FILE* file_ptr = fopen(directory, "rb");
+    source->data = NULL;
+    source->length = 0;
+    source->mapped = false;
+    if(file_ptr == NULL){
+        return false;
+    }
+
+    size_t capacity = SOURCE_READ_CHUNK;
+    source->data = malloc(capacity);
+    size_t read_amount;
+    while((read_amount = fread(source->data + source->length, 1, capacity - source->length, file_ptr)) > 0){
+        source->length += read_amount;
+        if(source->length == capacity){
+            capacity *= 2;
+            source->data = realloc(source->data, capacity);
+        }
+    }
+
+    fclose(file_ptr);
+    return true;
+}
+
+#else
+
+bool source_read_fd(Source* source, int fd){
+    size_t capacity = SOURCE_READ_CHUNK;
+    source->data = malloc(capacity);
+    source->length = 0;
+    source->mapped = false;
+
+    while(true){
+        if(source->length == capacity){
+            capacity *= 2;
+            source->data = realloc(source->data, capacity);
+        }
+        ssize_t read_amount = read(fd, source->data + source->length, capacity - source->length);
+        if(read_amount == 0){
+            return true;
+        }
+        if(read_amount < 0){
+            free(source->data);
+            source->data = NULL;
+            source->length = 0;
+            return false;
+        }
+        source->length += read_amount;
+    }
+}
+
+bool source_open(Source* source, char* directory){
+    source->data = NULL;
+    source->length = 0;
+    source->mapped = false;
+
+    int fd = open(directory, O_RDONLY);
+    if(fd == -1){
+        return false;
+    }
+
+    struct stat file_stat;
+    bool opened = false;
+    if(fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0){
+        void* mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping != MAP_FAILED){
+            madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+            source->data = mapping;
+            source->length = file_stat.st_size;
+            source->mapped = true;
+            opened = true;
+        }
+    }
+
+    if(!opened){
+        opened = source_read_fd(source, fd);
+    }
+
+    close(fd);
+    return opened;
+}
+
+#endif
+
+void source_close(Source* source){
+#ifndef _WIN32
+    if(source->mapped){
+        munmap(source->data, source->length);
+        source->data = NULL;
+        source->length = 0;
+        return;
+    }
+#endif
+    free(source->data);
+    source->data = NULL;
+    source->length = 0;
+}
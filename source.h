@@ -0,0 +1,22 @@
+#ifndef SOURCE
+#define SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Initial size of the buffer an unmappable input is read into. The buffer
+// doubles whenever it fills.
+#define SOURCE_READ_CHUNK 65536
+
+// Whole input file held in memory. Regular files are memory mapped, anything
+// that can't be mapped (pipes, character devices) is read into a heap buffer.
+typedef struct Source{
+    char* data;
+    size_t length;
+    bool mapped;
+} Source;
+
+bool source_open(Source* source, char* directory);
+void source_close(Source* source);
+
+#endif // SOURCE
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include "dynarray.h"
 #include "subset.h"
+#include "hash.h"
 
 void* _b_table_to_list(bool* b_table, int table_size, size_t stride){
     void* sub_list = _dynarray_create(DYNARRAY_DEFAULT_CAP, stride);
@@ -21,76 +22,82 @@ Subset SS_initialize_empty(int cap){
     Subset subset;
     subset.capacity = cap;
     subset.count = 0;
-    subset.table = malloc(cap * sizeof(bool));
-    memset(subset.table, 0, cap * sizeof(bool));
+    subset.word_count = SS_WORDS(cap);
+    subset.words = calloc(subset.word_count, sizeof(uint64_t));
 
     return subset;
 }
 
 Subset SS_initialize(int cap, int* add, int add_amount){
-    Subset subset;
-    subset.capacity = cap;
-    subset.count = 0;
-    subset.table = malloc(cap * sizeof(bool));
-    memset(subset.table, 0, cap * sizeof(bool));
+    Subset subset = SS_initialize_empty(cap);
 
     for(int i = 0;i<add_amount;i++){
         assert(add[i] < cap);
-        if(subset.table[add[i]] == false){
-            subset.table[add[i]] = true;
-            subset.count += 1;
-        }  
+        SS_add(&subset, add[i]);
     }
 
     return subset;
 }
 
 void SS_destroy(Subset* subset){
-    free(subset->table);
+    free(subset->words);
+}
+
+void SS_clear(Subset* subset){
+    memset(subset->words, 0, subset->word_count * sizeof(uint64_t));
+    subset->count = 0;
 }
 
 Subset SS_deep_copy(Subset subset){
-    Subset copy = SS_initialize_empty(subset.capacity);
+    Subset copy;
+    copy.capacity = subset.capacity;
     copy.count = subset.count;
-    for(int i = 0;i<subset.capacity;i++){
-        if(subset.table[i] == true){
-            copy.table[i] = true;
-        }
-    }
+    copy.word_count = subset.word_count;
+    copy.words = malloc(subset.word_count * sizeof(uint64_t));
+    memcpy(copy.words, subset.words, subset.word_count * sizeof(uint64_t));
 
     return copy;
 }
 
 void SS_add(Subset* subset, int new_state){
     assert(new_state < subset->capacity);
-    if(subset->table[new_state] == false){
-            subset->table[new_state] = true;
-            subset->count += 1;
-    }  
-    subset->table[new_state] = true;
+    uint64_t bit = SS_BIT(new_state);
+    uint64_t* word = &subset->words[SS_WORD(new_state)];
+    if((*word & bit) == 0){
+        *word |= bit;
+        subset->count += 1;
+    }
 }
 
 void SS_remove(Subset* subset, int rem_state){
     assert(rem_state < subset->capacity);
-    if(subset->table[rem_state] == true){
-            subset->table[rem_state] = false;
-            subset->count -= 1;
-    }  
+    uint64_t bit = SS_BIT(rem_state);
+    uint64_t* word = &subset->words[SS_WORD(rem_state)];
+    if((*word & bit) != 0){
+        *word &= ~bit;
+        subset->count -= 1;
+    }
 }
 
+// Word loops below are plain enough for the compiler to vectorize
 void _SS_union(Subset* subset1, Subset subset2){
     assert(subset1->capacity == subset2.capacity);
-    for(int i = 0;i<subset1->capacity;i++){
-        if(subset1->table[i] == false && subset2.table[i] == true){
-            subset1->count ++;
-            subset1->table[i] = true;
-        }
+    uint64_t* dst = subset1->words;
+    const uint64_t* src = subset2.words;
+    int count = 0;
+    for(int i = 0;i<subset1->word_count;i++){
+        dst[i] |= src[i];
+        count += __builtin_popcountll(dst[i]);
     }
+    subset1->count = count;
 }
 
 void _SS_inv(Subset* subset){
-    for(int i = 0;i<subset->capacity;i++){
-        subset->table[i] = !subset->table[i];
+    for(int i = 0;i<subset->word_count;i++){
+        subset->words[i] = ~subset->words[i];
+    }
+    if(subset->capacity % SS_WORD_BITS != 0){
+        subset->words[subset->word_count-1] &= SS_BIT(subset->capacity) - 1;
     }
 
     subset->count = subset->capacity - subset->count;
@@ -98,17 +105,33 @@ void _SS_inv(Subset* subset){
 
 bool SS_equal(Subset subset1, Subset subset2){
     assert(subset1.capacity == subset2.capacity);
-    for(int i = 0;i<subset1.capacity;i++){
-        if(subset1.table[i] != subset2.table[i]){
-            return false;
-        }
+    uint64_t diff = 0;
+    for(int i = 0;i<subset1.word_count;i++){
+        diff |= subset1.words[i] ^ subset2.words[i];
     }
-    return true;
+    return diff == 0;
 }
 
 bool SS_in(Subset subset1, int state){
     assert(state < subset1.capacity);
-    return subset1.table[state];
+    return (subset1.words[SS_WORD(state)] & SS_BIT(state)) != 0;
+}
+
+// Smallest member >= `from`, or -1 when there is none
+int SS_next(Subset subset, int from){
+    if(from >= subset.capacity){
+        return -1;
+    }
+    int w = SS_WORD(from);
+    uint64_t word = subset.words[w] & (~UINT64_C(0) << (from % SS_WORD_BITS));
+    while(word == 0){
+        w++;
+        if(w >= subset.word_count){
+            return -1;
+        }
+        word = subset.words[w];
+    }
+    return w * SS_WORD_BITS + __builtin_ctzll(word);
 }
 
 bool SS_list_in(Subset* subset_list, Subset elem){
@@ -132,17 +155,128 @@ int SS_list_index(Subset* subset_list, Subset elem){
 }
 
 int* SS_to_list_indexes(Subset subset){
-    return int_b_table_to_list(subset.table, subset.capacity);
+    int* sub_list = dynarray_create_prealloc(int, subset.count > 0 ? subset.count : DYNARRAY_DEFAULT_CAP);
+    for(int i = SS_next(subset, 0);i != -1;i = SS_next(subset, i+1)){
+        dynarray_push(sub_list, i);
+    }
+    return sub_list;
 }
 
 void SS_print(Subset subset){
     printf("Subset\n");
     printf("Capacity: %d\n", subset.capacity);
     printf("Length: %d\n", subset.count);
-    for(int i = 0; i < subset.capacity;i++){
-        if(subset.table[i] == true){
-            printf("%d, ", i);
-        } 
+    for(int i = SS_next(subset, 0);i != -1;i = SS_next(subset, i+1)){
+        printf("%d, ", i);
     }
     printf("\n");
 }
+
+SparseSet SPS_initialize_empty(int cap){
+    SparseSet set;
+    set.capacity = cap;
+    set.count = 0;
+    set.dense = malloc(cap * sizeof(int));
+    set.sparse = calloc(cap, sizeof(int));
+
+    return set;
+}
+
+void SPS_destroy(SparseSet* set){
+    free(set->dense);
+    free(set->sparse);
+}
+
+void SPS_clear(SparseSet* set){
+    set->count = 0;
+}
+
+bool SPS_in(SparseSet set, int elem){
+    assert(elem < set.capacity);
+    int slot = set.sparse[elem];
+    return slot < set.count && set.dense[slot] == elem;
+}
+
+// Returns true when `elem` was not a member yet
+bool SPS_add(SparseSet* set, int elem){
+    if(SPS_in(*set, elem)){
+        return false;
+    }
+    set->sparse[elem] = set->count;
+    set->dense[set->count] = elem;
+    set->count += 1;
+    return true;
+}
+
+int _SPS_compare(const void* a, const void* b){
+    return *(const int*) a - *(const int*) b;
+}
+
+// Orders the members ascending, for callers that need a stable iteration order
+void SPS_sort(SparseSet* set){
+    qsort(set->dense, set->count, sizeof(int), _SPS_compare);
+    for(int i = 0;i<set->count;i++){
+        set->sparse[set->dense[i]] = i;
+    }
+}
+
+uint64_t SS_hash(Subset subset){
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for(int i = 0;i<subset.word_count;i++){
+        h ^= subset.words[i];
+        h *= UINT64_C(0x100000001b3);
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+uint64_t _SSS_hash(void* elem_ptr){
+    IndexedSubset* elem = (IndexedSubset*) elem_ptr;
+    return SS_hash(elem->subset);
+}
+
+bool _SSS_equal(void* a_ptr, void* b_ptr){
+    IndexedSubset* a = (IndexedSubset*) a_ptr;
+    IndexedSubset* b = (IndexedSubset*) b_ptr;
+    if(a->subset.count != b->subset.count){
+        return false;
+    }
+    return SS_equal(a->subset, b->subset);
+}
+
+SubsetSet SSS_create(int buckets){
+    SubsetSet set;
+    set.hash = hash_create(buckets, IndexedSubset, _SSS_hash);
+    return set;
+}
+
+// The set only references the subsets, their tables stay owned by the caller
+void SSS_destroy(SubsetSet* set){
+    hash_destroy(set->hash);
+}
+
+int SSS_count(SubsetSet* set){
+    return set->hash.count;
+}
+
+int SSS_index(SubsetSet* set, Subset elem){
+    IndexedSubset lookup;
+    lookup.subset = elem;
+    lookup.index = -1;
+    IndexedSubset* stored = hash_get(set->hash, lookup, _SSS_equal);
+    if(stored == NULL){
+        return -1;
+    }
+    return stored->index;
+}
+
+// Adds `elem` with the next free index, or returns the index it already has
+int SSS_add(SubsetSet* set, Subset elem){
+    IndexedSubset new_elem;
+    new_elem.subset = elem;
+    new_elem.index = SSS_count(set);
+    if(hash_add(set->hash, new_elem, _SSS_equal)){
+        return SSS_index(set, elem);
+    }
+    return new_elem.index;
+}
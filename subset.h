@@ -1,21 +1,58 @@
+#ifndef SUBSET
+#define SUBSET
+
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h> 
+#include <stdint.h>
+#include "hash.h"
 
 #define int_b_table_to_list(b_table, table_size) _b_table_to_list(b_table, table_size, sizeof(int))
 #define char_b_table_to_list(b_table) _b_table_to_list(b_table, 256, sizeof(unsigned char))
+#define SS_WORD_BITS 64
+#define SS_WORDS(cap) (((cap) + SS_WORD_BITS - 1) / SS_WORD_BITS)
+#define SS_WORD(i) ((i) / SS_WORD_BITS)
+#define SS_BIT(i) (UINT64_C(1) << ((i) % SS_WORD_BITS))
+
 #define SS_union(x, y) _SS_union(&x, y)
 #define SS_inv(x) _SS_inv(&x)
 
+#define SSS_DEFAULT_BUCKETS 1024
+
+// Bitset over [0, capacity), one bit per element packed in 64 bit words.
+// `count` is kept up to date by every operation.
 typedef struct Subset{
-    bool* table;
+    uint64_t* words;
+    int word_count;
     int capacity;
     int count;
 } Subset;
 
+// Briggs-Torczon sparse set over [0, capacity). Members are dense[0 .. count)
+// in insertion order, so clearing is O(1) and iteration only visits members.
+typedef struct SparseSet{
+    int* dense;
+    int* sparse;
+    int capacity;
+    int count;
+} SparseSet;
+
+// Set of subsets keyed by content, every subset keeps the index it was
+// added with so callers can map subsets straight to their own numbering.
+typedef struct IndexedSubset{
+    Subset subset;
+    int index;
+} IndexedSubset;
+
+typedef struct SubsetSet{
+    Hash hash;
+} SubsetSet;
+
 void* _b_table_to_list(bool* b_table, int table_size, size_t stride);
 Subset SS_initialize_empty(int states_length);
 Subset SS_initialize(int states_length, int* add_states, int states_amount);
 void SS_destroy(Subset* subset);
+void SS_clear(Subset* subset);
 Subset SS_deep_copy(Subset subset);
 void SS_add(Subset* subset, int new_state);
 void SS_remove(Subset* subset, int rem_state);
@@ -23,7 +60,24 @@ void _SS_union(Subset* subset1, Subset subset2);
 void _SS_inv(Subset* subset);
 bool SS_equal(Subset subset1, Subset subset2);
 bool SS_in(Subset subset1, int state);
+int SS_next(Subset subset, int from);
 bool SS_list_in(Subset* subset_list, Subset elem);
 int SS_list_index(Subset* subset_list, Subset elem);
 int* SS_to_list_indexes(Subset subset);
-void SS_print(Subset subset);
\ No newline at end of file
+void SS_print(Subset subset);
+
+SparseSet SPS_initialize_empty(int cap);
+void SPS_destroy(SparseSet* set);
+void SPS_clear(SparseSet* set);
+bool SPS_in(SparseSet set, int elem);
+bool SPS_add(SparseSet* set, int elem);
+void SPS_sort(SparseSet* set);
+
+uint64_t SS_hash(Subset subset);
+SubsetSet SSS_create(int buckets);
+void SSS_destroy(SubsetSet* set);
+int SSS_count(SubsetSet* set);
+int SSS_index(SubsetSet* set, Subset elem);
+int SSS_add(SubsetSet* set, Subset elem);
+
+#endif // SUBSET
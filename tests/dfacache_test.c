@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "source.h"
+#include "dfacache.h"
+#include "language.h"
+
+// A DFA written to the cache and read back has to come out identical, and
+// a file that is cut short, from another version, under another key or
+// with tables pointing outside themselves has to be turned down. The same
+// for the visit profile stored next to it, and renumbering the DFA by that
+// profile must leave every token where it was.
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do{ if(!(cond)){ printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } }while(0)
+
+static char* cache_rules = "(ab*c)$02|(d|e)$03|(<-)$04|(<)$05|(( )( )*)$01";
+
+static bool same_dfa(FA a, FA b){
+    DFATable* ta = a.table;
+    DFATable* tb = b.table;
+    if(a.initial_state != b.initial_state || ta->states_count != tb->states_count || ta->class_count != tb->class_count){
+        return false;
+    }
+    if(memcmp(ta->classes, tb->classes, DFA_TABLE_WIDTH) != 0 || memcmp(a.alphabet, b.alphabet, sizeof(a.alphabet)) != 0){
+        return false;
+    }
+
+    size_t rows = (size_t) ta->states_count + 1;
+    if(memcmp(ta->next, tb->next, rows * ta->class_count * sizeof(int)) != 0 || memcmp(ta->accept, tb->accept, rows * sizeof(int)) != 0){
+        return false;
+    }
+
+    if(dynarray_length(a.acceptable_states) != dynarray_length(b.acceptable_states)){
+        return false;
+    }
+    for(int i = 0;i<dynarray_length(a.acceptable_states);i++){
+        if(a.acceptable_states[i].state != b.acceptable_states[i].state || a.acceptable_states[i].category != b.acceptable_states[i].category){
+            return false;
+        }
+    }
+    return true;
+}
+
+static char* read_file(char* path, size_t* length){
+    Source source;
+    if(!source_open(&source, path)){
+        return NULL;
+    }
+    char* data = malloc(source.length);
+    memcpy(data, source.data, source.length);
+    *length = source.length;
+    source_close(&source);
+    return data;
+}
+
+static void write_file(char* path, char* data, size_t length){
+    FILE* out = fopen(path, "wb");
+    fwrite(data, 1, length, out);
+    fclose(out);
+}
+
+// Writes `data` with `length` bytes over the cache file and expects a miss
+static void check_rejected(char* path, char* data, size_t length, char* what){
+    write_file(path, data, length);
+    FA loaded;
+    bool hit = DFA_cache_load(cache_rules, true, FA_THOMPSON, &loaded);
+    CHECK(!hit, "cache file with %s was loaded", what);
+    if(hit){
+        FA_destroy(&loaded);
+    }
+}
+
+static void check_round_trip(){
+    char path[512];
+    DFA_cache_path(DFA_cache_key(cache_rules, true, FA_THOMPSON), path, sizeof(path));
+    remove(path);
+
+    FA built = MakeFA(cache_rules, "output/dfacache_test_dfa.txt", true, FA_THOMPSON, false);
+    CHECK(DFA_cache_store(built, cache_rules, true, FA_THOMPSON), "store failed");
+
+    FA loaded;
+    bool hit = DFA_cache_load(cache_rules, true, FA_THOMPSON, &loaded);
+    CHECK(hit, "stored DFA didn't load");
+    if(hit){
+        CHECK(same_dfa(built, loaded), "loaded DFA differs from the stored one");
+        FA_destroy(&loaded);
+    }
+
+    FA other;
+    hit = DFA_cache_load(cache_rules, false, FA_THOMPSON, &other);
+    CHECK(!hit, "minimized DFA loaded for an unminimized request");
+    if(hit){
+        FA_destroy(&other);
+    }
+
+    size_t length;
+    char* original = read_file(path, &length);
+    CHECK(original != NULL, "no cache file at %s", path);
+    if(original == NULL){
+        FA_destroy(&built);
+        return;
+    }
+    char* data = malloc(length);
+    DFACacheHeader header;
+    memcpy(&header, original, sizeof(DFACacheHeader));
+    size_t next_offset = sizeof(DFACacheHeader) + DFA_CACHE_ALIGN(header.regex_length);
+
+    check_rejected(path, original, 0, "no bytes");
+    check_rejected(path, original, sizeof(DFACacheHeader) - 1, "half a header");
+    check_rejected(path, original, length / 2, "half its tables");
+    check_rejected(path, original, length - 1, "its last byte missing");
+
+    memcpy(data, original, length);
+    ((DFACacheHeader*) data)->version = DFA_CACHE_VERSION - 1;
+    check_rejected(path, data, length, "an older version");
+
+    memcpy(data, original, length);
+    ((DFACacheHeader*) data)->key ^= 1;
+    check_rejected(path, data, length, "another key");
+
+    memcpy(data, original, length);
+    data[sizeof(DFACacheHeader)] ^= 1;
+    check_rejected(path, data, length, "another regex");
+
+    memcpy(data, original, length);
+    ((DFACacheHeader*) data)->initial_state = header.states_count;
+    check_rejected(path, data, length, "the dead row as initial state");
+
+    int32_t bad_target = header.states_count + 1;
+    memcpy(data, original, length);
+    memcpy(data + next_offset, &bad_target, sizeof(int32_t));
+    check_rejected(path, data, length, "a transition past the dead row");
+
+    int32_t live_target = 0;
+    memcpy(data, original, length);
+    memcpy(data + next_offset + (size_t) header.states_count * header.class_count * sizeof(int32_t), &live_target, sizeof(int32_t));
+    check_rejected(path, data, length, "a dead row leading out of it");
+
+    // The untouched file loads again
+    write_file(path, original, length);
+    hit = DFA_cache_load(cache_rules, true, FA_THOMPSON, &loaded);
+    CHECK(hit, "restored cache file didn't load");
+    if(hit){
+        CHECK(same_dfa(built, loaded), "restored DFA differs");
+        FA_destroy(&loaded);
+    }
+
+    // MakeFA treats a rejected file as a miss and builds the DFA again
+    write_file(path, original, length / 2);
+    FA rebuilt = MakeFA(cache_rules, "output/dfacache_test_dfa.txt", true, FA_THOMPSON, false);
+    CHECK(same_dfa(built, rebuilt), "DFA rebuilt over a truncated file differs");
+    FA_destroy(&rebuilt);
+
+    free(data);
+    free(original);
+    FA_destroy(&built);
+}
+
+static bool same_spans(TokenSpan* a, TokenSpan* b){
+    if(dynarray_length(a) != dynarray_length(b)){
+        return false;
+    }
+    for(int i = 0;i<dynarray_length(a);i++){
+        if(a[i].offset != b[i].offset || a[i].length != b[i].length || a[i].category != b[i].category){
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_profile(){
+    char* rules = language_lexing_rules;
+    char* samples[] = {"languaje.k", "grammar.k.specs"};
+    int sample_count = sizeof(samples) / sizeof(samples[0]);
+    char* inputs[] = {"Init x <- 12; if(x =? 07){ y <- \"ab\"; } else { z <- x >= 0; }", "forx for fo <-- <= < -> - \"a", "", "\xc3\xa9t\xc3\xa9 <- 1"};
+    int input_count = sizeof(inputs) / sizeof(inputs[0]);
+
+    char path[512];
+    DFA_profile_path(DFA_cache_key(rules, true, FA_THOMPSON), path, sizeof(path));
+    size_t saved_length = 0;
+    char* saved = read_file(path, &saved_length);
+
+    FA dfa = MakeFA(rules, "output/dfacache_test_dfa.txt", true, FA_THOMPSON, false);
+    DFAProfile profile = DFA_profile_create(dfa.table);
+    for(int f = 0;f<sample_count;f++){
+        DFA_profile_file(&dfa, &profile, samples[f]);
+    }
+
+    size_t visits_size = (size_t) profile.states_count * sizeof(uint64_t);
+    size_t transitions_size = (size_t) profile.states_count * profile.class_count * sizeof(uint64_t);
+    uint64_t total = 0;
+    for(int s = 0;s<profile.states_count;s++){
+        total += profile.visits[s];
+    }
+    CHECK(total > 0, "profiling the samples counted nothing");
+
+    CHECK(DFA_profile_store(dfa, profile, rules, true, FA_THOMPSON), "profile store failed");
+    DFAProfile loaded;
+    bool hit = DFA_profile_load(dfa, rules, true, FA_THOMPSON, &loaded);
+    CHECK(hit, "stored profile didn't load");
+    if(hit){
+        CHECK(memcmp(profile.visits, loaded.visits, visits_size) == 0 && memcmp(profile.transitions, loaded.transitions, transitions_size) == 0,
+            "loaded profile differs from the stored one");
+        DFA_profile_destroy(&loaded);
+    }
+
+    size_t length;
+    char* stored = read_file(path, &length);
+    char* data = malloc(length);
+    for(size_t cut = 0;cut<length;cut += cut < sizeof(DFAProfileHeader) ? 7 : length / 3){
+        write_file(path, stored, cut);
+        hit = DFA_profile_load(dfa, rules, true, FA_THOMPSON, &loaded);
+        CHECK(!hit, "profile cut to %zu of %zu bytes was loaded", cut, length);
+        if(hit){
+            DFA_profile_destroy(&loaded);
+        }
+    }
+    memcpy(data, stored, length);
+    ((DFAProfileHeader*) data)->version = DFA_CACHE_VERSION - 1;
+    write_file(path, data, length);
+    hit = DFA_profile_load(dfa, rules, true, FA_THOMPSON, &loaded);
+    CHECK(!hit, "profile of an older version was loaded");
+    if(hit){
+        DFA_profile_destroy(&loaded);
+    }
+    memcpy(data, stored, length);
+    ((DFAProfileHeader*) data)->states_count--;
+    write_file(path, data, length);
+    hit = DFA_profile_load(dfa, rules, true, FA_THOMPSON, &loaded);
+    CHECK(!hit, "profile of a smaller DFA was loaded");
+    if(hit){
+        DFA_profile_destroy(&loaded);
+    }
+
+    // Tokens of every sample and input before renumbering
+    TokenSpan* before[16];
+    int stream_count = 0;
+    for(int f = 0;f<sample_count;f++){
+        TokenStream stream = scanner_spans_file_munch(dfa, samples[f], language_ignore_categories, language_ignore_count);
+        before[stream_count++] = stream.spans;
+        stream.spans = dynarray_create(TokenSpan);
+        token_stream_destroy(&stream);
+    }
+    for(int i = 0;i<input_count;i++){
+        TokenStream stream = scanner_spans_munch(dfa, inputs[i], strlen(inputs[i]), language_ignore_categories, language_ignore_count);
+        before[stream_count++] = stream.spans;
+        stream.spans = dynarray_create(TokenSpan);
+        token_stream_destroy(&stream);
+    }
+
+    int* order = DFA_profile_order(profile, dfa.table);
+    int hottest = 0;
+    bool* taken = calloc(profile.states_count, sizeof(bool));
+    for(int s = 0;s<profile.states_count;s++){
+        CHECK(order[s] >= 0 && order[s] < profile.states_count && !taken[order[s]], "state %d renumbered to %d twice or out of range", s, order[s]);
+        if(order[s] >= 0 && order[s] < profile.states_count){
+            taken[order[s]] = true;
+        }
+        if(profile.visits[s] > profile.visits[hottest]){
+            hottest = s;
+        }
+    }
+    CHECK(order[hottest] == 0, "hottest state %d renumbered to %d", hottest, order[hottest]);
+    free(taken);
+
+    DFA_renumber(&dfa, order);
+    int moved = 0;
+    for(int s = 0;s<profile.states_count;s++){
+        moved += order[s] != s;
+    }
+    CHECK(moved > 0, "the profile left every state in place, nothing was checked");
+    free(order);
+
+    stream_count = 0;
+    for(int f = 0;f<sample_count;f++){
+        TokenStream stream = scanner_spans_file_munch(dfa, samples[f], language_ignore_categories, language_ignore_count);
+        CHECK(same_spans(before[stream_count], stream.spans), "renumbering changed the tokens of %s", samples[f]);
+        dynarray_destroy(before[stream_count++]);
+        token_stream_destroy(&stream);
+    }
+    for(int i = 0;i<input_count;i++){
+        TokenStream stream = scanner_spans_munch(dfa, inputs[i], strlen(inputs[i]), language_ignore_categories, language_ignore_count);
+        CHECK(same_spans(before[stream_count], stream.spans), "renumbering changed the tokens of \"%s\"", inputs[i]);
+        dynarray_destroy(before[stream_count++]);
+        token_stream_destroy(&stream);
+    }
+
+    // Leave whatever profile the build had stored in place
+    if(saved != NULL){
+        write_file(path, saved, saved_length);
+    }
+    else{
+        remove(path);
+    }
+
+    free(saved);
+    free(stored);
+    free(data);
+    DFA_profile_destroy(&profile);
+    FA_destroy(&dfa);
+}
+
+int main(){
+    // grammar.k.specs and one of the inputs don't lex all the way through
+    // the language rules, which is fine for comparing token streams
+    scanner_report_errors = false;
+
+    check_round_trip();
+    check_profile();
+
+    if(failures > 0){
+        printf("dfacache_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("dfacache_test: ok\n");
+    return 0;
+}
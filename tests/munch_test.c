@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "language.h"
+
+// scanner_spans_munch against a plain longest match that walks the DFA
+// table from every token start, plus the window of failed marks it keeps.
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do{ if(!(cond)){ printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } }while(0)
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng_next(){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Longest match by brute force: no memo, every token start runs the DFA
+// until it dies. Stops without an END token where no rule accepts.
+static TokenSpan* naive_longest_match(FA dfa, char* src, size_t length, int* ignore_cats, int amount_ignore){
+    DFATable* table = dfa.table;
+    TokenSpan* spans = dynarray_create(TokenSpan);
+
+    size_t word_start = 0;
+    while(word_start < length){
+        int state = dfa.initial_state;
+        int category = -1;
+        size_t word_end = word_start;
+        for(size_t i = word_start;i<length;i++){
+            state = DFA_table_next(table, state, src[i]);
+            if(state == table->dead_state){
+                break;
+            }
+            if(table->accept[state] != -1){
+                category = table->accept[state];
+                word_end = i + 1;
+            }
+        }
+        if(category == -1){
+            return spans;
+        }
+
+        bool ignored = false;
+        for(int k = 0;k<amount_ignore;k++){
+            ignored = ignored || ignore_cats[k] == category;
+        }
+        if(!ignored){
+            TokenSpan span = {word_start, (int) (word_end - word_start), category};
+            dynarray_push(spans, span);
+        }
+        word_start = word_end;
+    }
+
+    TokenSpan final_span = {0, 0, 0};
+    dynarray_push(spans, final_span);
+    return spans;
+}
+
+static bool same_spans(TokenSpan* a, TokenSpan* b){
+    if(dynarray_length(a) != dynarray_length(b)){
+        return false;
+    }
+    for(int i = 0;i<dynarray_length(a);i++){
+        if(a[i].offset != b[i].offset || a[i].length != b[i].length || a[i].category != b[i].category){
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_random_inputs(char* name, char* rules, const char** pieces, int piece_count, int* ignore_cats, int amount_ignore){
+    FA dfa = MakeFA(rules, "output/munch_test_dfa.txt", true, FA_THOMPSON, false);
+    char buffer[4096];
+
+    for(int round = 0;round<20000;round++){
+        size_t length = 0;
+        // Every tenth input is long enough to wrap the window of marks
+        int count = round % 10 == 0 ? rng_next() % 1000 : rng_next() % 16;
+        for(int k = 0;k<count;k++){
+            const char* piece = pieces[rng_next() % piece_count];
+            size_t piece_length = strlen(piece);
+            if(length + piece_length >= sizeof(buffer)){
+                break;
+            }
+            memcpy(buffer + length, piece, piece_length);
+            length += piece_length;
+        }
+        buffer[length] = '\0';
+
+        TokenStream stream = scanner_spans_munch(dfa, buffer, length, ignore_cats, amount_ignore);
+        TokenSpan* expected = naive_longest_match(dfa, buffer, length, ignore_cats, amount_ignore);
+        bool same = same_spans(stream.spans, expected);
+        CHECK(same, "%s: tokens differ on \"%s\"", name, buffer);
+        token_stream_destroy(&stream);
+        dynarray_destroy(expected);
+        if(!same){
+            break;
+        }
+    }
+
+    FA_destroy(&dfa);
+}
+
+// A token that runs to the end of the input before failing, again from
+// every position: quadratic without the marks
+static void check_linear_time(){
+    FA dfa = MakeFA("(a*b)$02|a$03", "output/munch_test_dfa.txt", true, FA_THOMPSON, false);
+    size_t length = 200000;
+    char* src = malloc(length);
+    memset(src, 'a', length);
+
+    clock_t start = clock();
+    TokenStream stream = scanner_spans_munch(dfa, src, length, NULL, 0);
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    CHECK(dynarray_length(stream.spans) == length + 1, "linear: %zu tokens for %zu bytes", dynarray_length(stream.spans), length);
+    CHECK(seconds < 2.0, "linear: %.2fs over %zu bytes", seconds, length);
+
+    token_stream_destroy(&stream);
+    free(src);
+    FA_destroy(&dfa);
+}
+
+// The window only spans from the current token start to the furthest mark,
+// however far into the input the scan is
+static void check_marks_window(){
+    ScanMarks marks;
+    marks.bits = NULL;
+    marks.positions = NULL;
+    marks.capacity = 0;
+    marks.row_words = (300 + 63) / 64;
+
+    for(size_t low = 0;low<1000000;low += 7){
+        for(size_t k = 1;k<=5;k++){
+            CHECK(scanner_marks_set(&marks, low, low + k, (int) ((low + k) % 300)), "window: set failed");
+        }
+        CHECK(scanner_marks_test(&marks, low + 3, (int) ((low + 3) % 300)), "window: lost a mark at %zu", low + 3);
+        CHECK(!scanner_marks_test(&marks, low + 3, (int) ((low + 4) % 300)), "window: stray mark at %zu", low + 3);
+    }
+    CHECK(marks.capacity == SCANNER_MARKS_MIN, "window: grew to %zu positions", marks.capacity);
+
+    CHECK(scanner_marks_set(&marks, 2000000, 2000000 + 1000, 7), "window: far set failed");
+    CHECK(scanner_marks_test(&marks, 2000000 + 1000, 7), "window: far mark lost");
+    CHECK(marks.capacity >= 1001 && marks.capacity <= 2048, "window: %zu positions for a span of 1001", marks.capacity);
+    scanner_marks_destroy(&marks);
+}
+
+int main(){
+    // Random inputs hit the error path on purpose, the checks say what failed
+    scanner_report_errors = false;
+
+    const char* language_pieces[] = {"if", "x", "for", "fo", " ", "\n", "<", "<-", "<=", "=", "=?", "-", ">", "->",
+        "0", "12", "07", "\"ab\"", "\"a", "\"", "_x", "(", ")", "{", "}", ";", ".", ",", "$", "\xc3\xa9", "\xe4", "\xff"};
+    check_random_inputs("language", language_lexing_rules, language_pieces, sizeof(language_pieces) / sizeof(language_pieces[0]),
+        language_ignore_categories, language_ignore_count);
+
+    const char* rollback_pieces[] = {"a", "b", "c", "ab", "abbb", "abc", " ", "d"};
+    int no_ignore[] = {-1};
+    check_random_inputs("rollback", "(ab*c)$02|a$03|b$04|c$05|(( )( )*)$01", rollback_pieces, sizeof(rollback_pieces) / sizeof(rollback_pieces[0]), no_ignore, 0);
+
+    const char* operator_pieces[] = {"<", "-", "<-", "<--", "=", "<=", "x"};
+    check_random_inputs("operators", "(<)$02|(<--)$03|(<=)$04|-$05|=$06|x$07", operator_pieces, sizeof(operator_pieces) / sizeof(operator_pieces[0]), no_ignore, 0);
+
+    check_linear_time();
+    check_marks_window();
+
+    if(failures > 0){
+        printf("munch_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("munch_test: ok\n");
+    return 0;
+}
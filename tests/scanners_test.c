@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "lazydfa.h"
+#include "keywords.h"
+#include "lexer.h"
+#include "language.h"
+
+// Every scanning engine against scanner_spans_buffer on the same inputs:
+// parallel chunks, the pull scanner, the lazy DFA and a Glushkov-built DFA. The generated
+// direct-coded lexer and Lexer take the longest match, so they are held
+// against scanner_spans_munch instead, Lexer sequentially and from several
+// threads.
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do{ if(!(cond)){ printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } }while(0)
+
+static uint32_t rng_state = 2024;
+
+static uint32_t rng_next(){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+#define INVALID_PIECES 4
+
+static const char* pieces[] = {"if", "else", "x", "for", "fo", "forx", "Init", "continue", "cont", " ", "\n", "\t",
+    "<", "<-", "<=", "=", " =? ", "-", ">", "->", "0", "12", "07", "\"ab\"", "_x", "x9", "(", ")", "{", "}",
+    ";", ".", ",", "[", "]", "\xc3\xa9", "\xe5\x8f\x98\xe9\x87\x8f", "\"\xc3\xbc\"",
+    "\"a", "\xe4", "\xff", "$"};
+
+// Random concatenation of pieces. The last INVALID_PIECES can't be lexed
+// in every context, they are left out when `valid` so the whole input lexes.
+// "=?" is spaced out for the same reason: right after '<' it would scan as
+// "<=" and a lone '?'.
+static char* random_input(size_t target, bool valid, size_t* length){
+    int piece_count = sizeof(pieces) / sizeof(pieces[0]);
+    char* src = dynarray_create(char);
+    while(dynarray_length(src) < target){
+        int p = rng_next() % piece_count;
+        if(valid && p >= piece_count - INVALID_PIECES){
+            continue;
+        }
+        dynarray_extend(src, (char*) pieces[p], strlen(pieces[p]));
+    }
+    *length = dynarray_length(src);
+    char terminator = '\0';
+    dynarray_push(src, terminator);
+    return src;
+}
+
+static bool same_stream(TokenStream a, TokenStream b){
+    if(dynarray_length(a.spans) != dynarray_length(b.spans)){
+        return false;
+    }
+    for(int i = 0;i<dynarray_length(a.spans);i++){
+        if(a.spans[i].length != b.spans[i].length || a.spans[i].category != b.spans[i].category){
+            return false;
+        }
+        if(memcmp(token_stream_word(a, i), token_stream_word(b, i), a.spans[i].length) != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_small_inputs(FA dfa, FA glushkov_dfa){
+    size_t budgets[] = {1, 5000, 100000000};
+    LazyDFA* lazy[3];
+    for(int b = 0;b<3;b++){
+        lazy[b] = MakeLazyFA(language_lexing_rules, budgets[b], false);
+    }
+
+    for(int round = 0;round<5000;round++){
+        size_t length;
+        char* src = random_input(rng_next() % 64, round % 2 == 0, &length);
+        int ignore_count = round % 3 == 0 ? 0 : language_ignore_count;
+
+        TokenStream expected = scanner_spans_buffer(dfa, src, length, language_ignore_categories, ignore_count, false);
+
+        TokenStream munch = scanner_spans_munch(dfa, src, length, language_ignore_categories, ignore_count);
+        TokenStream direct = scanner_spans_direct(lexer_match, src, length, language_ignore_categories, ignore_count);
+        CHECK(same_stream(munch, direct), "direct differs on \"%s\"", src);
+        token_stream_destroy(&munch);
+        token_stream_destroy(&direct);
+
+        TokenStream glushkov = scanner_spans_buffer(glushkov_dfa, src, length, language_ignore_categories, ignore_count, false);
+        CHECK(same_stream(expected, glushkov), "glushkov differs on \"%s\"", src);
+        token_stream_destroy(&glushkov);
+
+        for(int b = 0;b<3;b++){
+            TokenStream lazy_stream = scanner_spans_lazy(lazy[b], src, length, language_ignore_categories, ignore_count);
+            CHECK(same_stream(expected, lazy_stream), "lazy (%zu byte budget) differs on \"%s\"", budgets[b], src);
+            token_stream_destroy(&lazy_stream);
+        }
+
+        token_stream_destroy(&expected);
+        dynarray_destroy(src);
+    }
+
+    for(int b = 0;b<3;b++){
+        LDFA_destroy(lazy[b]);
+    }
+}
+
+// Inputs big enough for every thread to get a chunk
+static void check_parallel(FA dfa){
+    for(int round = 0;round<6;round++){
+        size_t length;
+        char* src = random_input(4 * SCANNER_PARALLEL_MIN_CHUNK + rng_next() % 100000, round != 5, &length);
+
+        TokenStream expected = scanner_spans_buffer(dfa, src, length, language_ignore_categories, language_ignore_count, false);
+        TokenSpan last = expected.spans[dynarray_length(expected.spans) - 1];
+        CHECK(round == 5 || (last.length == 0 && last.category == 0), "parallel: valid input didn't lex to the end");
+        for(int threads = 2;threads<=4;threads++){
+            TokenStream parallel = scanner_spans_parallel(dfa, src, length, language_ignore_categories, language_ignore_count, threads);
+            CHECK(same_stream(expected, parallel), "parallel (%d threads) differs on a %zu byte input", threads, length);
+            token_stream_destroy(&parallel);
+        }
+
+        token_stream_destroy(&expected);
+        dynarray_destroy(src);
+    }
+}
+
+// scanner_next_token against scanner_loop_file on files several windows
+// long, so tokens straddle refills. The last file puts a token longer than
+// the whole window in the middle, which has to grow it.
+static void check_pull_scanner(FA dfa){
+    char* directory = "output/scanners_test_pull.k";
+    for(int round = 0;round<5;round++){
+        size_t length;
+        char* src = random_input(3 * SCANNER_WINDOW + rng_next() % 10000, round != 3, &length);
+        FILE* out = fopen(directory, "wb");
+        fwrite(src, 1, length, out);
+        if(round == 4){
+            for(int i = 0;i<2 * SCANNER_WINDOW;i++){
+                fputc(i % 7 == 0 ? '_' : 'x', out);
+            }
+            fwrite(src, 1, length, out);
+        }
+        fclose(out);
+        dynarray_destroy(src);
+
+        Token* expected = scanner_loop_file(dfa, directory, language_ignore_categories, language_ignore_count);
+        Scanner* scanner = scanner_open(dfa, directory, language_ignore_categories, language_ignore_count);
+        int count = 0;
+        Token token;
+        while(scanner_next_token(scanner, &token)){
+            bool same = count < dynarray_length(expected)
+                && token.category == expected[count].category
+                && strcmp(token.word, expected[count].word) == 0;
+            CHECK(same, "pull scanner differs at token %d of round %d", count, round);
+            if(!same){
+                break;
+            }
+            count++;
+        }
+        CHECK(count == dynarray_length(expected), "pull scanner gave %d of %d tokens in round %d", count, (int) dynarray_length(expected), round);
+        scanner_close(scanner);
+
+        for(int i = 0;i<dynarray_length(expected);i++){
+            if(expected[i].word[0] != '\0'){
+                free(expected[i].word);
+            }
+        }
+        dynarray_destroy(expected);
+    }
+    remove(directory);
+}
+
+static void check_lexer(FA dfa){
+    KeywordTable* keywords = keyword_table_create(language_keywords, language_keyword_count, LANGUAGE_IDENTIFIER);
+    Lexer* lexer = lexer_create(dfa, language_ignore_categories, language_ignore_count, language_keywords, language_keyword_count, LANGUAGE_IDENTIFIER);
+
+    for(int round = 0;round<2000;round++){
+        size_t length;
+        char* src = random_input(rng_next() % 64, round % 2 == 0, &length);
+
+        TokenStream expected = scanner_spans_munch(dfa, src, length, language_ignore_categories, language_ignore_count);
+        token_stream_apply_keywords(&expected, keywords);
+        TokenStream scanned = lexer_scan(lexer, src, length);
+        CHECK(same_stream(expected, scanned), "lexer differs on \"%s\"", src);
+
+        token_stream_destroy(&expected);
+        token_stream_destroy(&scanned);
+        dynarray_destroy(src);
+    }
+
+    char* directories[6];
+    for(int f = 0;f<6;f++){
+        directories[f] = malloc(64);
+        snprintf(directories[f], 64, "output/scanners_test_%d.k", f);
+        size_t length;
+        char* src = random_input(20000 * (f + 1), true, &length);
+        FILE* out = fopen(directories[f], "wb");
+        fwrite(src, 1, length, out);
+        fclose(out);
+        dynarray_destroy(src);
+    }
+
+    TokenStream* streams = lexer_scan_files(lexer, directories, 6, 3);
+    for(int f = 0;f<6;f++){
+        TokenStream expected = lexer_scan_file(lexer, directories[f]);
+        CHECK(same_stream(expected, streams[f]), "lexer_scan_files differs on %s", directories[f]);
+        token_stream_destroy(&expected);
+        token_stream_destroy(&streams[f]);
+        remove(directories[f]);
+        free(directories[f]);
+    }
+    free(streams);
+
+    lexer_destroy(lexer);
+    keyword_table_destroy(keywords);
+}
+
+int main(){
+    // Invalid pieces hit the error path on purpose. A scan that stops early
+    // has no END token, so same_stream still tells the engines apart.
+    scanner_report_errors = false;
+
+    FA dfa = MakeFA(language_lexing_rules, "output/scanners_test_dfa.txt", true, FA_THOMPSON, false);
+    FA glushkov_dfa = MakeFA(language_lexing_rules, "output/scanners_test_dfa.txt", false, FA_GLUSHKOV, false);
+
+    check_small_inputs(dfa, glushkov_dfa);
+    check_parallel(dfa);
+    check_pull_scanner(dfa);
+    check_lexer(dfa);
+
+    FA_destroy(&dfa);
+    FA_destroy(&glushkov_dfa);
+
+    if(failures > 0){
+        printf("scanners_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("scanners_test: ok\n");
+    return 0;
+}
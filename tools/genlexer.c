@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "dynarray.h"
+#include "scanner.h"
+#include "lexgen.h"
+#include "dfacache.h"
+#include "language.h"
+
+// Build step: compiles the language lexer and writes it out as the
+// direct-coded `lexer_match`, so binaries link the state machine instead of
+// building it from the regex when they start.
+//
+// States are numbered hottest first from the visit profile stored next to
+// the cached DFA. Any sample files given after the output are scanned and
+// added to that profile before it is used (`make profile`).
+int main(int argc, char** argv){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s <output.c> [sample ...]\n", argv[0]);
+        return 1;
+    }
+
+    char* rules = language_lexing_rules;
+    FA dfa = MakeFA(rules, "output/lexer_dfa.txt", true, FA_THOMPSON, false);
+
+    DFAProfile profile;
+    bool profiled = DFA_profile_load(dfa, rules, true, FA_THOMPSON, &profile);
+    if(!profiled){
+        profile = DFA_profile_create(dfa.table);
+    }
+    for(int i = 2;i<argc;i++){
+        DFA_profile_file(&dfa, &profile, argv[i]);
+        profiled = true;
+    }
+    if(argc > 2 && !DFA_profile_store(dfa, profile, rules, true, FA_THOMPSON)){
+        fprintf(stderr, "could not store the lexer profile\n");
+    }
+    if(profiled){
+        int* order = DFA_profile_order(profile, dfa.table);
+        DFA_renumber(&dfa, order);
+        free(order);
+    }
+    DFA_profile_destroy(&profile);
+
+    bool written = DFA_export_c_file(dfa, "lexer", argv[1]);
+    FA_destroy(&dfa);
+
+    if(!written){
+        fprintf(stderr, "could not write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -2,14 +2,22 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <string.h>
 #include "dynarray.h"
 #include "tree.h"
 
 
 TreeNode* tree_make_node(int amount_nodes, char* name, TreeNode** nodes){
+    return tree_make_node_span(amount_nodes, name, strlen(name), nodes);
+}
+
+// `name` doesn't need to be null terminated, the node keeps pointing into
+// whatever buffer it came from (e.g. a token span of the scanned source).
+TreeNode* tree_make_node_span(int amount_nodes, char* name, int name_length, TreeNode** nodes){
     TreeNode* new_node = malloc(sizeof(TreeNode));
     new_node->children_amount = amount_nodes;
     new_node->name = name;
+    new_node->name_length = name_length;
     new_node->children = malloc(amount_nodes*sizeof(TreeNode*));
 
     for (int i = 0; i < amount_nodes; i++) {
@@ -29,7 +37,8 @@ void print_node_info(TreeNode* node) {
         return;
     }
 
-    printf("[Node] Name: %s | Children: %d\n", 
+    printf("[Node] Name: %.*s | Children: %d\n", 
+            node->name_length,
             node->name, 
             node->children_amount);
 }
@@ -39,10 +48,10 @@ void print_tree(TreeNode* node, char* prefix, bool is_last, bool is_root) {
 
     if (is_root) {
         // No branch characters for the very first node
-        printf("%s\n", node->name);
+        printf("%.*s\n", node->name_length, node->name);
     } else {
         // Standard branch for everyone else
-        printf("%s%s%s\n", prefix, is_last ? "└── " : "├── ", node->name);
+        printf("%s%s%.*s\n", prefix, is_last ? "└── " : "├── ", node->name_length, node->name);
         //printf("%s%s%s\n", prefix, is_last ? "└── " : "├── ", node->name);
     }
 
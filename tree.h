@@ -5,11 +5,13 @@
 
 typedef struct TreeNode{
     char* name;
+    int name_length;
     int children_amount;
     struct TreeNode** children;
 } TreeNode;
 
 TreeNode* tree_make_node(int amount_nodes, char* name, TreeNode** nodes);
+TreeNode* tree_make_node_span(int amount_nodes, char* name, int name_length, TreeNode** nodes);
 void print_tree(TreeNode* node, char* prefix, bool is_last, bool is_root);;
 void print_node_info(TreeNode* node);
 void tree_destroy_node(TreeNode* node);
\ No newline at end of file
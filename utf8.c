@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "dynarray.h"
+#include "utf8.h"
+
+// Writes the encoding of `codepoint` to `out` and returns its length
+int utf8_encode(uint32_t codepoint, unsigned char* out){
+    assert(codepoint <= UTF8_MAX_CODEPOINT);
+    if(codepoint < 0x80){
+        out[0] = (unsigned char) codepoint;
+        return 1;
+    }
+    if(codepoint < 0x800){
+        out[0] = (unsigned char) (0xC0 | (codepoint >> 6));
+        out[1] = (unsigned char) (0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if(codepoint < 0x10000){
+        out[0] = (unsigned char) (0xE0 | (codepoint >> 12));
+        out[1] = (unsigned char) (0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (unsigned char) (0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (unsigned char) (0xF0 | (codepoint >> 18));
+    out[1] = (unsigned char) (0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (unsigned char) (0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (unsigned char) (0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Appends to `sequences` the byte range sequences matching the encodings of
+// [low, high]. The range is cut where the encoded length changes and around
+// the surrogates, then until every continuation byte past the first
+// differing one spans its full 0x80-0xBF, at which point the encodings of
+// `low` and `high` bound each position on their own.
+void utf8_split_range(uint32_t low, uint32_t high, UTF8Sequence** sequences){
+    assert(high <= UTF8_MAX_CODEPOINT);
+    if(low > high){
+        return;
+    }
+
+    if(low <= 0xDFFF && high >= 0xD800){
+        if(low < 0xD800){
+            utf8_split_range(low, 0xD7FF, sequences);
+        }
+        if(high > 0xDFFF){
+            utf8_split_range(0xE000, high, sequences);
+        }
+        return;
+    }
+
+    uint32_t length_max[UTF8_MAX_BYTES - 1] = {0x7F, 0x7FF, 0xFFFF};
+    for(int i = 0;i<UTF8_MAX_BYTES - 1;i++){
+        if(low <= length_max[i] && high > length_max[i]){
+            utf8_split_range(low, length_max[i], sequences);
+            utf8_split_range(length_max[i] + 1, high, sequences);
+            return;
+        }
+    }
+
+    for(int i = 1;i<UTF8_MAX_BYTES && high > 0x7F;i++){
+        uint32_t mask = ((uint32_t) 1 << (6 * i)) - 1;
+        if((low & ~mask) == (high & ~mask)){
+            continue;
+        }
+        if((low & mask) != 0){
+            utf8_split_range(low, low | mask, sequences);
+            utf8_split_range((low | mask) + 1, high, sequences);
+            return;
+        }
+        if((high & mask) != mask){
+            utf8_split_range(low, (high & ~mask) - 1, sequences);
+            utf8_split_range(high & ~mask, high, sequences);
+            return;
+        }
+    }
+
+    UTF8Sequence sequence;
+    sequence.length = utf8_encode(low, sequence.low);
+    int high_length = utf8_encode(high, sequence.high);
+    assert(sequence.length == high_length);
+    dynarray_push(*sequences, sequence);
+}
+
+// Returns the length of the longest well formed UTF-8 prefix of src, so
+// `length` when all of it is. Overlong forms, surrogates and codepoints past
+// U+10FFFF are rejected. Runs of ASCII are skipped a vector at a time.
+size_t utf8_validate(const char* src, size_t length){
+    size_t i = 0;
+    while(i < length){
+#if defined(__AVX2__)
+        while(i + 32 <= length && _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) (src + i))) == 0){
+            i += 32;
+        }
+#elif defined(__SSE2__)
+        while(i + 16 <= length && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (src + i))) == 0){
+            i += 16;
+        }
+#endif
+        if(i == length){
+            break;
+        }
+
+        unsigned char c = (unsigned char) src[i];
+        if(c < 0x80){
+            i++;
+            continue;
+        }
+
+        int sequence_length;
+        uint32_t codepoint;
+        uint32_t min_codepoint;
+        if((c & 0xE0) == 0xC0){
+            sequence_length = 2;
+            codepoint = c & 0x1F;
+            min_codepoint = 0x80;
+        }
+        else if((c & 0xF0) == 0xE0){
+            sequence_length = 3;
+            codepoint = c & 0x0F;
+            min_codepoint = 0x800;
+        }
+        else if((c & 0xF8) == 0xF0){
+            sequence_length = 4;
+            codepoint = c & 0x07;
+            min_codepoint = 0x10000;
+        }
+        else{
+            return i;
+        }
+
+        if(length - i < (size_t) sequence_length){
+            return i;
+        }
+        for(int k = 1;k<sequence_length;k++){
+            unsigned char continuation = (unsigned char) src[i + k];
+            if((continuation & 0xC0) != 0x80){
+                return i;
+            }
+            codepoint = (codepoint << 6) | (continuation & 0x3F);
+        }
+        if(codepoint < min_codepoint || codepoint > UTF8_MAX_CODEPOINT || (codepoint >= 0xD800 && codepoint <= 0xDFFF)){
+            return i;
+        }
+
+        i += sequence_length;
+    }
+
+    return length;
+}
@@ -0,0 +1,24 @@
+#ifndef UTF8
+#define UTF8
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTF8_MAX_CODEPOINT 0x10FFFF
+#define UTF8_MAX_BYTES 4
+
+// Byte strings of `length` bytes whose i-th byte lies in [low[i], high[i]].
+// A codepoint range splits into a few of these that together hold exactly
+// the encodings of its codepoints.
+typedef struct UTF8Sequence{
+    int length;
+    unsigned char low[UTF8_MAX_BYTES];
+    unsigned char high[UTF8_MAX_BYTES];
+} UTF8Sequence;
+
+int utf8_encode(uint32_t codepoint, unsigned char* out);
+void utf8_split_range(uint32_t low, uint32_t high, UTF8Sequence** sequences);
+size_t utf8_validate(const char* src, size_t length);
+
+#endif // UTF8